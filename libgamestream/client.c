@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 #ifdef __3DS__
 #include "uuid.h"
@@ -113,6 +114,79 @@ static int load_unique_id(const char* keyDirectory) {
   return GS_OK;
 }
 
+// The identity every request is made with, loaded the first time it's needed
+const char* gs_unique_id(const char* keyDirectory) {
+  if (unique_id[0] == 0) {
+    mkdirtree(keyDirectory);
+    if (load_unique_id(keyDirectory) != GS_OK)
+      return NULL;
+  }
+
+  return unique_id;
+}
+
+static void save_cert(const char* keyDirectory, CERT_KEY_PAIR certKeyPair) {
+  char certificateFilePath[PATH_MAX];
+  snprintf(certificateFilePath, PATH_MAX, "%s/%s", keyDirectory, CERTIFICATE_FILE_NAME);
+
+  char keyFilePath[PATH_MAX];
+  snprintf(keyFilePath, PATH_MAX, "%s/%s", keyDirectory, KEY_FILE_NAME);
+
+  char p12FilePath[PATH_MAX];
+  snprintf(p12FilePath, PATH_MAX, "%s/%s", keyDirectory, P12_FILE_NAME);
+
+  mkdirtree(keyDirectory);
+  mkcert_save(certificateFilePath, p12FilePath, keyFilePath, certKeyPair);
+}
+
+bool gs_has_cert(const char* keyDirectory) {
+  char certificateFilePath[PATH_MAX];
+  snprintf(certificateFilePath, PATH_MAX, "%s/%s", keyDirectory, CERTIFICATE_FILE_NAME);
+
+  char keyFilePath[PATH_MAX];
+  snprintf(keyFilePath, PATH_MAX, "%s/%s", keyDirectory, KEY_FILE_NAME);
+
+  return access(certificateFilePath, F_OK) == 0 && access(keyFilePath, F_OK) == 0;
+}
+
+// Slow on weak CPUs, callers can run this ahead of gs_init on a thread of
+// their own so load_cert finds the certificate in place
+int gs_generate_cert(const char* keyDirectory, MKCERT_KEY_TYPE keyType, MKCERT_PROGRESS progress, void* context) {
+  CERT_KEY_PAIR cert = mkcert_generate_key(keyType, progress, context);
+  if (cert.x509 == NULL || cert.pkey == NULL || cert.p12 == NULL) {
+    gs_error = "Failed to generate certificate";
+    mkcert_free(cert);
+    return GS_FAILED;
+  }
+
+  save_cert(keyDirectory, cert);
+  mkcert_free(cert);
+  return GS_OK;
+}
+
+// Copies a certificate and key from importDirectory, named like the ones
+// generated here
+int gs_import_cert(const char* keyDirectory, const char* importDirectory) {
+  char certificateFilePath[PATH_MAX];
+  snprintf(certificateFilePath, PATH_MAX, "%s/%s", importDirectory, CERTIFICATE_FILE_NAME);
+
+  char keyFilePath[PATH_MAX];
+  snprintf(keyFilePath, PATH_MAX, "%s/%s", importDirectory, KEY_FILE_NAME);
+
+  if (access(certificateFilePath, F_OK) != 0 || access(keyFilePath, F_OK) != 0)
+    return GS_IO_ERROR;
+
+  CERT_KEY_PAIR cert;
+  if (!mkcert_load(certificateFilePath, keyFilePath, &cert)) {
+    gs_error = "Certificate and key don't match or can't be read";
+    return GS_INVALID;
+  }
+
+  save_cert(keyDirectory, cert);
+  mkcert_free(cert);
+  return GS_OK;
+}
+
 static int load_cert(const char* keyDirectory) {
   char certificateFilePath[PATH_MAX];
   snprintf(certificateFilePath, PATH_MAX, "%s/%s", keyDirectory, CERTIFICATE_FILE_NAME);
@@ -123,14 +197,8 @@ static int load_cert(const char* keyDirectory) {
   FILE *fd = fopen(certificateFilePath, "r");
   if (fd == NULL) {
     printf("Generating certificate...");
-    CERT_KEY_PAIR cert = mkcert_generate();
+    gs_generate_cert(keyDirectory, MKCERT_KEY_RSA_2048, NULL, NULL);
     printf("done\n");
-
-    char p12FilePath[PATH_MAX];
-    snprintf(p12FilePath, PATH_MAX, "%s/%s", keyDirectory, P12_FILE_NAME);
-
-    mkcert_save(certificateFilePath, p12FilePath, keyFilePath, cert);
-    mkcert_free(cert);
     fd = fopen(certificateFilePath, "r");
   }
 
@@ -195,42 +263,27 @@ static int load_serverinfo(PSERVER_DATA server, bool https) {
     goto cleanup;
   }
 
-  if (xml_status(data->memory, data->size) == GS_ERROR) {
-    ret = GS_ERROR;
-    goto cleanup;
-  }
+  XML_FIELD fields[] = {
+    { "currentgame", &currentGameText },
+    { "PairStatus", &pairedText },
+    { "appversion", (char**) &server->serverInfo.serverInfoAppVersion },
+    { "state", &stateText },
+    { "ServerCodecModeSupport", &serverCodecModeSupportText },
+    { "gputype", &server->gpuType },
+    { "GsVersion", &server->gsVersion },
+    { "GfeVersion", (char**) &server->serverInfo.serverInfoGfeVersion },
+    { "HttpsPort", &httpsPortText },
+    { "uniqueid", &server->uniqueId },
+  };
 
-  if (xml_search(data->memory, data->size, "currentgame", &currentGameText) != GS_OK) {
+  // Every field and the display modes come out of a single parse
+  int status = xml_search_fields(data->memory, data->size, fields, sizeof(fields) / sizeof(fields[0]), &server->modes);
+  if (status != GS_OK) {
+    if (status == GS_ERROR)
+      ret = GS_ERROR;
     goto cleanup;
   }
 
-  if (xml_search(data->memory, data->size, "PairStatus", &pairedText) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "appversion", (char**) &server->serverInfo.serverInfoAppVersion) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "state", &stateText) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "ServerCodecModeSupport", &serverCodecModeSupportText) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "gputype", &server->gpuType) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "GsVersion", &server->gsVersion) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "GfeVersion", (char**) &server->serverInfo.serverInfoGfeVersion) != GS_OK)
-    goto cleanup;
-
-  if (xml_search(data->memory, data->size, "HttpsPort", &httpsPortText) != GS_OK)
-    goto cleanup;
-
-  if (xml_modelist(data->memory, data->size, &server->modes) != GS_OK)
-    goto cleanup;
-
   // These fields are present on all version of GFE that this client supports
   if (!strlen(currentGameText) || !strlen(pairedText) || !strlen(server->serverInfo.serverInfoAppVersion) || !strlen(stateText))
     goto cleanup;
@@ -423,6 +476,9 @@ int gs_unpair(PSERVER_DATA server) {
   snprintf(url, sizeof(url), "http://%s:%u/unpair?uniqueid=%s&uuid=%s", server->serverInfo.address, server->httpPort, unique_id, uuid_str);
   ret = http_request(url, data);
 
+  // Connections made while paired must not outlive the pairing
+  http_reset();
+
   http_free_data(data);
   return ret;
 }
@@ -654,6 +710,9 @@ int gs_pair(PSERVER_DATA server, char* pin) {
 
   server->paired = true;
 
+  // Connections and sessions from before pairing are still unauthenticated
+  http_reset();
+
   cleanup:
   if (ret != GS_OK)
     gs_unpair(server);
@@ -833,6 +892,12 @@ int gs_init(PSERVER_DATA server, char *address, unsigned short httpPort, const c
   return load_server_status(server);
 }
 
+// Lets another thread stop a request that is taking too long, requests
+// fail with GS_FAILED until this is called again with false
+void gs_abort_requests(bool abort) {
+  http_abort(abort);
+}
+
 void gs_cleanup() {
   if (cert != NULL)
     X509_free(cert);
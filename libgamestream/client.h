@@ -20,6 +20,7 @@
 #pragma once
 
 #include "xml.h"
+#include "mkcert.h"
 
 #include <Limelight.h>
 
@@ -40,14 +41,20 @@ typedef struct _SERVER_DATA {
   int currentGame;
   int serverMajorVersion;
   char* gsVersion;
+  char* uniqueId;
   PDISPLAY_MODE modes;
   SERVER_INFORMATION serverInfo;
   unsigned short httpPort;
   unsigned short httpsPort;
 } SERVER_DATA, *PSERVER_DATA;
 
+bool gs_has_cert(const char* keyDirectory);
+const char* gs_unique_id(const char* keyDirectory);
+int gs_generate_cert(const char* keyDirectory, MKCERT_KEY_TYPE keyType, MKCERT_PROGRESS progress, void* context);
+int gs_import_cert(const char* keyDirectory, const char* importDirectory);
 int gs_init(PSERVER_DATA server, char* address, unsigned short httpPort, const char *keyDirectory, int logLevel, bool unsupported);
 void gs_cleanup();
+void gs_abort_requests(bool abort);
 int gs_start_app(PSERVER_DATA server, PSTREAM_CONFIGURATION config, int appId, bool sops, bool localaudio, int gamepad_mask);
 int gs_applist(PSERVER_DATA server, PAPP_LIST *app_list);
 int gs_unpair(PSERVER_DATA server);
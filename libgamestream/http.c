@@ -20,6 +20,7 @@
 #include "http.h"
 #include "errors.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <string.h>
 #include <curl/curl.h>
@@ -27,6 +28,15 @@
 static CURL *curl;
 
 static bool debug;
+// Set once a request went through on the current handle, only then can
+// there be a kept connection or session to refuse
+static bool handle_used;
+static unsigned long handshakes;
+// Set from another thread to give up on the request in flight
+static atomic_bool abort_requested;
+
+static char certificateFilePath[4096];
+static char keyFilePath[4096];
 
 static size_t _write_curl(void *contents, size_t size, size_t nmemb, void *userp)
 {
@@ -44,51 +54,145 @@ static size_t _write_curl(void *contents, size_t size, size_t nmemb, void *userp
   return realsize;
 }
 
+static int _http_progress(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+  return atomic_load(&abort_requested) ? 1 : 0;
+}
+
+static CURL* _http_create_handle() {
+  CURL *handle = curl_easy_init();
+  if (!handle)
+    return NULL;
+
+  curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
+  curl_easy_setopt(handle, CURLOPT_SSLENGINE_DEFAULT, 1L);
+  curl_easy_setopt(handle, CURLOPT_SSLCERTTYPE,"PEM");
+  curl_easy_setopt(handle, CURLOPT_SSLCERT, certificateFilePath);
+  curl_easy_setopt(handle, CURLOPT_SSLKEYTYPE, "PEM");
+  curl_easy_setopt(handle, CURLOPT_SSLKEY, keyFilePath);
+  curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, _write_curl);
+  curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+  // Keep connections open and resume TLS sessions, a full handshake with
+  // client certificate authentication takes seconds on slow hardware
+  curl_easy_setopt(handle, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, _http_progress);
+  curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+
+  return handle;
+}
+
 int http_init(const char* keyDirectory, int logLevel) {
-  curl = curl_easy_init();
   debug = logLevel >= 2;
-  if (!curl)
-    return GS_FAILED;
 
-  char certificateFilePath[4096];
   snprintf(certificateFilePath, sizeof(certificateFilePath), "%s/%s", keyDirectory, CERTIFICATE_FILE_NAME);
-
-  char keyFilePath[4096];
   snprintf(keyFilePath, sizeof(keyFilePath), "%s/%s", keyDirectory, KEY_FILE_NAME);
 
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-  curl_easy_setopt(curl, CURLOPT_SSLENGINE_DEFAULT, 1L);
-  curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE,"PEM");
-  curl_easy_setopt(curl, CURLOPT_SSLCERT, certificateFilePath);
-  curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "PEM");
-  curl_easy_setopt(curl, CURLOPT_SSLKEY, keyFilePath);
-  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_curl);
-  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
-  curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 0L);
+  curl = _http_create_handle();
+  handle_used = false;
+  if (!curl)
+    return GS_FAILED;
+
+  return GS_OK;
+}
 
+// Drops every open connection and cached TLS session. Both carry the
+// authentication state of the client certificate, which pairing changes.
+int http_reset() {
+  CURL *handle = _http_create_handle();
+  if (!handle)
+    return GS_FAILED;
+
+  curl_easy_cleanup(curl);
+  curl = handle;
+  handle_used = false;
   return GS_OK;
 }
 
+// Requests that don't change any state on the server and can be sent twice
+static const char* idempotent_paths[] = { "/serverinfo", "/applist" };
+
+static bool _http_idempotent(const char* url) {
+  const char* path = strstr(url, "://");
+  path = strchr(path != NULL ? path + 3 : url, '/');
+  if (path == NULL)
+    return false;
+
+  size_t len = strcspn(path, "?");
+  for (size_t i = 0; i < sizeof(idempotent_paths) / sizeof(idempotent_paths[0]); i++) {
+    if (strlen(idempotent_paths[i]) == len && strncmp(path, idempotent_paths[i], len) == 0)
+      return true;
+  }
+  return false;
+}
+
+// Errors a server can give when it won't take back a kept-alive connection
+// or a resumed TLS session. A refused handshake fails before any of the
+// request went out, anything later may have reached the server and is only
+// retried when sending it again is harmless.
+static bool _http_reuse_refused(CURLcode res, const char* url) {
+  if (res == CURLE_SSL_CONNECT_ERROR)
+    return true;
+
+  return (res == CURLE_SEND_ERROR || res == CURLE_RECV_ERROR ||
+          res == CURLE_GOT_NOTHING) && _http_idempotent(url);
+}
+
+static void _http_log_connection() {
+  long connects = 0;
+  curl_off_t connect_time = 0;
+  curl_off_t appconnect_time = 0;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect_time);
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect_time);
+
+  // The TLS handshake time stays at 0 on a reused connection
+  if (appconnect_time > 0)
+    handshakes++;
+
+  if (debug) {
+    if (appconnect_time > 0)
+      printf("TLS handshake %ld ms, %lu handshakes total\n", (long) ((appconnect_time - connect_time) / 1000), handshakes);
+    else if (connects == 0)
+      printf("Reused connection, %lu handshakes total\n", handshakes);
+  }
+}
+
 int http_request(char* url, PHTTP_DATA data) {
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
-  curl_easy_setopt(curl, CURLOPT_URL, url);
-#ifdef __FreeBSD__
-  curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1);
-#endif
+  CURLcode res;
 
   if (debug)
     printf("Request %s\n", url);
 
-  if (data->size > 0) {
-    free(data->memory);
-    data->memory = malloc(1);
-    if(data->memory == NULL)
-      return GS_OUT_OF_MEMORY;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+#ifdef __FreeBSD__
+    curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1);
+#endif
+
+    if (data->size > 0) {
+      free(data->memory);
+      data->memory = malloc(1);
+      if(data->memory == NULL)
+        return GS_OUT_OF_MEMORY;
+
+      data->size = 0;
+    }
+    res = curl_easy_perform(curl);
+    _http_log_connection();
+
+    // Start over without any kept connection or session if the server
+    // refused to reuse them
+    if (res == CURLE_OK || !handle_used || !_http_reuse_refused(res, url))
+      break;
+
+    if (debug)
+      printf("Retrying without connection reuse: %s\n", curl_easy_strerror(res));
 
-    data->size = 0;
+    if (http_reset() != GS_OK)
+      break;
   }
-  CURLcode res = curl_easy_perform(curl);
 
   if(res != CURLE_OK) {
     gs_error = curl_easy_strerror(res);
@@ -96,6 +200,7 @@ int http_request(char* url, PHTTP_DATA data) {
   } else if (data->memory == NULL) {
     return GS_OUT_OF_MEMORY;
   }
+  handle_used = true;
 
   if (debug)
     printf("Response:\n%s\n\n", data->memory);
@@ -103,6 +208,11 @@ int http_request(char* url, PHTTP_DATA data) {
   return GS_OK;
 }
 
+// While set, the request in flight and any new one are aborted
+void http_abort(bool abort) {
+  atomic_store(&abort_requested, abort);
+}
+
 void http_cleanup() {
   curl_easy_cleanup(curl);
 }
@@ -19,6 +19,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #define CERTIFICATE_FILE_NAME "client.pem"
@@ -32,5 +33,7 @@ typedef struct _HTTP_DATA {
 int http_init(const char* keyDirectory, int logLevel);
 PHTTP_DATA http_create_data();
 int http_request(char* url, PHTTP_DATA data);
+int http_reset();
+void http_abort(bool abort);
 void http_cleanup();
 void http_free_data(PHTTP_DATA data);
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 
 #include <openssl/crypto.h>
+#include <openssl/ec.h>
 #include <openssl/pem.h>
 #include <openssl/conf.h>
 #include <openssl/pkcs12.h>
@@ -27,13 +28,21 @@
 #include <openssl/engine.h>
 #endif
 
-static const int NUM_BITS = 2048;
 static const int SERIAL = 0;
 static const int NUM_YEARS = 10;
 
-int mkcert(X509 **x509p, EVP_PKEY **pkeyp, int bits, int serial, int years);
+struct mkcert_progress {
+    MKCERT_PROGRESS callback;
+    void* context;
+};
+
+int mkcert(X509 **x509p, EVP_PKEY **pkeyp, MKCERT_KEY_TYPE keyType, struct mkcert_progress *progress, int serial, int years);
 
 CERT_KEY_PAIR mkcert_generate() {
+    return mkcert_generate_key(MKCERT_KEY_RSA_2048, NULL, NULL);
+}
+
+CERT_KEY_PAIR mkcert_generate_key(MKCERT_KEY_TYPE keyType, MKCERT_PROGRESS progress, void* context) {
     BIO *bio_err;
     X509 *x509 = NULL;
     EVP_PKEY *pkey = NULL;
@@ -44,9 +53,9 @@ CERT_KEY_PAIR mkcert_generate() {
     OpenSSL_add_all_algorithms();
     ERR_load_crypto_strings();
 
-    mkcert(&x509, &pkey, NUM_BITS, SERIAL, NUM_YEARS);
-
-    p12 = PKCS12_create("limelight", "GameStream", pkey, x509, NULL, 0, 0, 0, 0, 0);
+    struct mkcert_progress keygenProgress = { progress, context };
+    if (mkcert(&x509, &pkey, keyType, &keygenProgress, SERIAL, NUM_YEARS))
+        p12 = PKCS12_create("limelight", "GameStream", pkey, x509, NULL, 0, 0, 0, 0, 0);
 
 #ifndef OPENSSL_NO_ENGINE
     ENGINE_cleanup();
@@ -58,6 +67,40 @@ CERT_KEY_PAIR mkcert_generate() {
     return (CERT_KEY_PAIR) {x509, pkey, p12};
 }
 
+int mkcert_load(const char* certFile, const char* keyPairFile, PCERT_KEY_PAIR certKeyPair) {
+    X509 *x509 = NULL;
+    EVP_PKEY *pkey = NULL;
+
+    FILE* certFilePtr = fopen(certFile, "r");
+    if (certFilePtr != NULL) {
+        x509 = PEM_read_X509(certFilePtr, NULL, NULL, NULL);
+        fclose(certFilePtr);
+    }
+
+    FILE* keyPairFilePtr = fopen(keyPairFile, "r");
+    if (keyPairFilePtr != NULL) {
+        pkey = PEM_read_PrivateKey(keyPairFilePtr, NULL, NULL, NULL);
+        fclose(keyPairFilePtr);
+    }
+
+    // The key has to be the one the certificate was made for
+    if (x509 == NULL || pkey == NULL || !X509_check_private_key(x509, pkey)) {
+        X509_free(x509);
+        EVP_PKEY_free(pkey);
+        return(0);
+    }
+
+    certKeyPair->x509 = x509;
+    certKeyPair->pkey = pkey;
+    certKeyPair->p12 = PKCS12_create("limelight", "GameStream", pkey, x509, NULL, 0, 0, 0, 0, 0);
+    if (certKeyPair->p12 == NULL) {
+        X509_free(x509);
+        EVP_PKEY_free(pkey);
+        return(0);
+    }
+    return(1);
+}
+
 void mkcert_free(CERT_KEY_PAIR certKeyPair) {
     X509_free(certKeyPair.x509);
     EVP_PKEY_free(certKeyPair.pkey);
@@ -79,16 +122,33 @@ void mkcert_save(const char* certFile, const char* p12File, const char* keyPairF
     fclose(keyPairFilePtr);
 }
 
-int mkcert(X509 **x509p, EVP_PKEY **pkeyp, int bits, int serial, int years) {
-    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+static int keygen_cb(EVP_PKEY_CTX *ctx) {
+    struct mkcert_progress *progress = EVP_PKEY_CTX_get_app_data(ctx);
+    progress->callback(EVP_PKEY_CTX_get_keygen_info(ctx, 0), EVP_PKEY_CTX_get_keygen_info(ctx, 1), progress->context);
+    return 1;
+}
+
+int mkcert(X509 **x509p, EVP_PKEY **pkeyp, MKCERT_KEY_TYPE keyType, struct mkcert_progress *progress, int serial, int years) {
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(keyType == MKCERT_KEY_EC_P256 ? EVP_PKEY_EC : EVP_PKEY_RSA, NULL);
     EVP_PKEY_keygen_init(ctx);
-    EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, bits);
+    if (keyType == MKCERT_KEY_EC_P256) {
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+        EVP_PKEY_CTX_set_ec_param_enc(ctx, OPENSSL_EC_NAMED_CURVE);
+    } else {
+        EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, keyType == MKCERT_KEY_RSA_1024 ? 1024 : 2048);
+    }
+    if (progress->callback != NULL) {
+        EVP_PKEY_CTX_set_app_data(ctx, progress);
+        EVP_PKEY_CTX_set_cb(ctx, keygen_cb);
+    }
 
     // pk must be initialized on input
     EVP_PKEY *pk = NULL;;
-    EVP_PKEY_keygen(ctx, &pk);
+    int rc = EVP_PKEY_keygen(ctx, &pk);
 
     EVP_PKEY_CTX_free(ctx);
+    if (rc <= 0)
+        return(0);
 
     X509* cert = X509_new();
     X509_set_version(cert, 2);
@@ -27,6 +27,18 @@ typedef struct _CERT_KEY_PAIR {
     PKCS12 *p12;
 } CERT_KEY_PAIR, *PCERT_KEY_PAIR;
 
+typedef enum _MKCERT_KEY_TYPE {
+    MKCERT_KEY_RSA_2048,
+    // Cheaper to generate and use, not every host accepts them
+    MKCERT_KEY_RSA_1024,
+    MKCERT_KEY_EC_P256,
+} MKCERT_KEY_TYPE;
+
+// Called during key generation with OpenSSL's keygen stage and counter
+typedef void (*MKCERT_PROGRESS)(int stage, int count, void* context);
+
 CERT_KEY_PAIR mkcert_generate();
+CERT_KEY_PAIR mkcert_generate_key(MKCERT_KEY_TYPE keyType, MKCERT_PROGRESS progress, void* context);
+int mkcert_load(const char* certFile, const char* keyPairFile, PCERT_KEY_PAIR certKeyPair);
 void mkcert_free(CERT_KEY_PAIR);
 void mkcert_save(const char* certFile, const char* p12File, const char* keyPairFile, CERT_KEY_PAIR certKeyPair);
@@ -0,0 +1,268 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "probe.h"
+#include "http.h"
+#include "xml.h"
+#include "errors.h"
+
+#include <Limelight.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <curl/curl.h>
+#ifdef __3DS__
+#include "uuid.h"
+#else
+#include <uuid/uuid.h>
+#endif
+
+#define UUID_STRLEN 37
+#define DEFAULT_HTTPS_PORT 47984
+
+enum probe_phase {
+  PROBE_HTTP,
+  PROBE_HTTPS,
+  PROBE_DONE,
+};
+
+struct probe_host {
+  PROBE_RESULT result;
+  enum probe_phase phase;
+  CURL *curl;
+  HTTP_DATA data;
+};
+
+struct probe_state {
+  CURLM *multi;
+  const char* keyDirectory;
+  /* Hosts only report pairing for the identity the client paired with */
+  const char* uniqueId;
+  unsigned short httpPort;
+  uint64_t deadline;
+  PROBE_CALLBACK callback;
+  void* context;
+};
+
+static size_t _probe_write(void *contents, size_t size, size_t nmemb, void *userp) {
+  size_t realsize = size * nmemb;
+  PHTTP_DATA mem = (PHTTP_DATA)userp;
+
+  char* memory = realloc(mem->memory, mem->size + realsize + 1);
+  if(memory == NULL)
+    return 0;
+
+  memcpy(&memory[mem->size], contents, realsize);
+  mem->memory = memory;
+  mem->size += realsize;
+  mem->memory[mem->size] = 0;
+
+  return realsize;
+}
+
+static void _probe_finish(struct probe_state *state, struct probe_host *host, int status) {
+  host->phase = PROBE_DONE;
+  host->result.status = status;
+  state->callback(&host->result, state->context);
+}
+
+/* Starts the next request for a host, the deadline covers both of them */
+static int _probe_start(struct probe_state *state, struct probe_host *host, unsigned short port) {
+  char url[4096];
+  char keyPath[4096];
+  uuid_t uuid;
+  char uuid_str[UUID_STRLEN];
+  bool https = host->phase == PROBE_HTTPS;
+
+  uint64_t now = LiGetMillis();
+  if (now >= state->deadline)
+    return GS_IO_ERROR;
+
+  uuid_generate_random(uuid);
+  uuid_unparse(uuid, uuid_str);
+  snprintf(url, sizeof(url), "%s://%s:%u/serverinfo?uniqueid=%s&uuid=%s",
+    https ? "https" : "http", host->result.address, port, state->uniqueId, uuid_str);
+
+  CURL *curl = curl_easy_init();
+  if (curl == NULL)
+    return GS_OUT_OF_MEMORY;
+
+  host->data.size = 0;
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, host);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _probe_write);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &host->data);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long) (state->deadline - now));
+  if (https) {
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
+    snprintf(keyPath, sizeof(keyPath), "%s/%s", state->keyDirectory, CERTIFICATE_FILE_NAME);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, keyPath);
+    curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "PEM");
+    snprintf(keyPath, sizeof(keyPath), "%s/%s", state->keyDirectory, KEY_FILE_NAME);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, keyPath);
+  }
+
+  if (curl_multi_add_handle(state->multi, curl) != CURLM_OK) {
+    curl_easy_cleanup(curl);
+    return GS_FAILED;
+  }
+  host->curl = curl;
+  return GS_OK;
+}
+
+/* Reads what a serverinfo response says about the host, same rules as
+ * load_serverinfo */
+static int _probe_parse(struct probe_host *host, unsigned short *httpsPort) {
+  char *currentGameText = NULL;
+  char *pairedText = NULL;
+  char *stateText = NULL;
+  char *httpsPortText = NULL;
+  XML_FIELD fields[] = {
+    { "currentgame", &currentGameText },
+    { "PairStatus", &pairedText },
+    { "state", &stateText },
+    { "HttpsPort", &httpsPortText },
+  };
+
+  int ret = xml_search_fields(host->data.memory, host->data.size, fields, sizeof(fields) / sizeof(fields[0]), NULL);
+  if (ret != GS_OK)
+    return ret;
+
+  host->result.pairing = strcmp(pairedText, "1") == 0 ? PROBE_PAIRED : PROBE_NOT_PAIRED;
+  host->result.currentGame = strstr(stateText, "_SERVER_BUSY") == NULL ? 0 : atoi(currentGameText);
+  *httpsPort = atoi(httpsPortText);
+  if (!*httpsPort)
+    *httpsPort = DEFAULT_HTTPS_PORT;
+
+  free(currentGameText);
+  free(pairedText);
+  free(stateText);
+  free(httpsPortText);
+  return GS_OK;
+}
+
+static void _probe_done(struct probe_state *state, struct probe_host *host, CURLcode res) {
+  unsigned short httpsPort;
+
+  curl_multi_remove_handle(state->multi, host->curl);
+  curl_easy_cleanup(host->curl);
+  host->curl = NULL;
+
+  int ret = res == CURLE_OK ? _probe_parse(host, &httpsPort) : GS_IO_ERROR;
+  if (host->phase == PROBE_HTTP) {
+    if (ret != GS_OK) {
+      _probe_finish(state, host, ret);
+      return;
+    }
+
+    // Pairing is only reported accurately over HTTPS
+    host->result.pairing = PROBE_PAIRING_UNKNOWN;
+    host->phase = PROBE_HTTPS;
+    ret = _probe_start(state, host, httpsPort);
+    if (ret != GS_OK)
+      _probe_finish(state, host, GS_OK);
+  } else {
+    // Hosts refuse the handshake or the request from clients they aren't
+    // paired with. Anything else, like running out of time, says nothing.
+    if (res == CURLE_SSL_CONNECT_ERROR || res == CURLE_HTTP_RETURNED_ERROR || ret == GS_ERROR)
+      host->result.pairing = PROBE_NOT_PAIRED;
+    else if (ret != GS_OK)
+      host->result.pairing = PROBE_PAIRING_UNKNOWN;
+    _probe_finish(state, host, GS_OK);
+  }
+}
+
+// Queries /serverinfo on every host at once. The callback runs once per host
+// as soon as its status is known, hosts that don't answer within timeoutMs
+// are reported with GS_IO_ERROR. uniqueId is the client's identity from
+// gs_unique_id.
+int gs_probe_hosts(const char** addresses, int count, unsigned short httpPort, const char* keyDirectory, const char* uniqueId, int timeoutMs, PROBE_CALLBACK callback, void* context) {
+  struct probe_state state;
+  int ret = GS_OK;
+
+  struct probe_host *hosts = calloc(count, sizeof(struct probe_host));
+  if (hosts == NULL)
+    return GS_OUT_OF_MEMORY;
+
+  curl_global_init(CURL_GLOBAL_ALL);
+  state.multi = curl_multi_init();
+  if (state.multi == NULL) {
+    curl_global_cleanup();
+    free(hosts);
+    return GS_OUT_OF_MEMORY;
+  }
+  state.keyDirectory = keyDirectory;
+  state.uniqueId = uniqueId;
+  state.httpPort = httpPort ? httpPort : 47989;
+  state.deadline = LiGetMillis() + timeoutMs;
+  state.callback = callback;
+  state.context = context;
+
+  for (int i = 0; i < count; i++) {
+    hosts[i].result.index = i;
+    hosts[i].result.address = addresses[i];
+    hosts[i].phase = PROBE_HTTP;
+    int status = _probe_start(&state, &hosts[i], state.httpPort);
+    if (status != GS_OK)
+      _probe_finish(&state, &hosts[i], status);
+  }
+
+  int running = 1;
+  while (running > 0) {
+    if (curl_multi_perform(state.multi, &running) != CURLM_OK) {
+      ret = GS_FAILED;
+      break;
+    }
+
+    CURLMsg *msg;
+    int queued;
+    while ((msg = curl_multi_info_read(state.multi, &queued)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      struct probe_host *host;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**) &host);
+      _probe_done(&state, host, msg->data.result);
+      // A host may have moved on to its HTTPS request
+      running = 1;
+    }
+
+    if (running > 0)
+      curl_multi_wait(state.multi, NULL, 0, 100, NULL);
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (hosts[i].curl != NULL) {
+      curl_multi_remove_handle(state.multi, hosts[i].curl);
+      curl_easy_cleanup(hosts[i].curl);
+    }
+    if (hosts[i].phase != PROBE_DONE)
+      _probe_finish(&state, &hosts[i], GS_IO_ERROR);
+    free(hosts[i].data.memory);
+  }
+
+  curl_multi_cleanup(state.multi);
+  curl_global_cleanup();
+  free(hosts);
+  return ret;
+}
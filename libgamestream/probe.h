@@ -0,0 +1,48 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum _PROBE_PAIRING {
+  /* The HTTPS request didn't settle before the deadline */
+  PROBE_PAIRING_UNKNOWN,
+  PROBE_PAIRED,
+  PROBE_NOT_PAIRED,
+} PROBE_PAIRING;
+
+typedef struct _PROBE_RESULT {
+  int index;
+  const char* address;
+  /* GS_OK when the host answered before the deadline */
+  int status;
+  PROBE_PAIRING pairing;
+  int currentGame;
+} PROBE_RESULT, *PPROBE_RESULT;
+
+typedef void (*PROBE_CALLBACK)(const PROBE_RESULT* result, void* context);
+
+int gs_probe_hosts(const char** addresses, int count, unsigned short httpPort, const char* keyDirectory, const char* uniqueId, int timeoutMs, PROBE_CALLBACK callback, void* context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -21,9 +21,12 @@
 #include "errors.h"
 
 #include <expat.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define STATUS_OK 200
+#define XML_MAX_FIELDS 16
 
 struct xml_query {
   char *memory;
@@ -32,6 +35,17 @@ struct xml_query {
   void* data;
 };
 
+struct xml_fields_query {
+  PXML_FIELD fields[XML_MAX_FIELDS];
+  char* memory[XML_MAX_FIELDS];
+  size_t size[XML_MAX_FIELDS];
+  int start[XML_MAX_FIELDS];
+  int count;
+  int status;
+  bool out_of_memory;
+  struct xml_query* modes;
+};
+
 static void XMLCALL _xml_start_element(void *userData, const char *name, const char **atts) {
   struct xml_query *search = (struct xml_query*) userData;
   if (strcmp(search->data, name) == 0)
@@ -137,6 +151,64 @@ static void XMLCALL _xml_write_data(void *userData, const XML_Char *s, int len)
   }
 }
 
+static int _xml_compare_fields(const void *a, const void *b) {
+  return strcmp((*(PXML_FIELD*) a)->node, (*(PXML_FIELD*) b)->node);
+}
+
+static int _xml_compare_node(const void *key, const void *field) {
+  return strcmp((const char*) key, (*(PXML_FIELD*) field)->node);
+}
+
+static int _xml_find_field(struct xml_fields_query *query, const char *name) {
+  PXML_FIELD* field = bsearch(name, query->fields, query->count, sizeof(PXML_FIELD), _xml_compare_node);
+  return field == NULL ? -1 : field - query->fields;
+}
+
+static void XMLCALL _xml_start_fields_element(void *userData, const char *name, const char **atts) {
+  struct xml_fields_query *query = (struct xml_fields_query*) userData;
+  int i = _xml_find_field(query, name);
+  if (i >= 0)
+    query->start[i]++;
+
+  if (query->modes != NULL)
+    _xml_start_mode_element(query->modes, name, atts);
+
+  if (strcmp("root", name) == 0)
+    _xml_start_status_element(&query->status, name, atts);
+}
+
+static void XMLCALL _xml_end_fields_element(void *userData, const char *name) {
+  struct xml_fields_query *query = (struct xml_fields_query*) userData;
+  int i = _xml_find_field(query, name);
+  if (i >= 0)
+    query->start[i]--;
+
+  if (query->modes != NULL)
+    _xml_end_mode_element(query->modes, name);
+}
+
+static void XMLCALL _xml_write_fields_data(void *userData, const XML_Char *s, int len) {
+  struct xml_fields_query *query = (struct xml_fields_query*) userData;
+  for (int i = 0; i < query->count; i++) {
+    if (query->start[i] <= 0 || query->memory[i] == NULL)
+      continue;
+
+    char* memory = realloc(query->memory[i], query->size[i] + len + 1);
+    if (memory == NULL) {
+      query->out_of_memory = true;
+      continue;
+    }
+
+    memcpy(&memory[query->size[i]], s, len);
+    query->size[i] += len;
+    memory[query->size[i]] = 0;
+    query->memory[i] = memory;
+  }
+
+  if (query->modes != NULL)
+    _xml_write_data(query->modes, s, len);
+}
+
 int xml_search(char* data, size_t len, char* node, char** result) {
   struct xml_query search;
   search.data = node;
@@ -164,6 +236,66 @@ int xml_search(char* data, size_t len, char* node, char** result) {
   return GS_OK;
 }
 
+// Fills every field and, if mode_list is set, the display modes in a single
+// parse of the document. Like xml_status, fails with GS_ERROR when the root
+// element doesn't report success. Results are only written on GS_OK.
+int xml_search_fields(char* data, size_t len, PXML_FIELD fields, int count, PDISPLAY_MODE *mode_list) {
+  struct xml_fields_query query = {0};
+  struct xml_query modes = {0};
+  int ret = GS_OK;
+
+  if (count > XML_MAX_FIELDS)
+    return GS_INVALID;
+
+  query.count = count;
+  query.modes = mode_list != NULL ? &modes : NULL;
+  for (int i = 0; i < count; i++)
+    query.fields[i] = &fields[i];
+
+  // Sorted so every element name is a binary search instead of a parse
+  qsort(query.fields, count, sizeof(PXML_FIELD), _xml_compare_fields);
+  for (int i = 0; i < count; i++) {
+    query.memory[i] = calloc(1, 1);
+    if (query.memory[i] == NULL)
+      query.out_of_memory = true;
+  }
+
+  XML_Parser parser = XML_ParserCreate("UTF-8");
+  XML_SetUserData(parser, &query);
+  XML_SetElementHandler(parser, _xml_start_fields_element, _xml_end_fields_element);
+  XML_SetCharacterDataHandler(parser, _xml_write_fields_data);
+  if (! XML_Parse(parser, data, len, 1)) {
+    int code = XML_GetErrorCode(parser);
+    gs_error = XML_ErrorString(code);
+    ret = GS_INVALID;
+  } else if (query.out_of_memory) {
+    ret = GS_OUT_OF_MEMORY;
+  } else if (query.status != STATUS_OK) {
+    ret = GS_ERROR;
+  }
+  XML_ParserFree(parser);
+
+  for (int i = 0; i < count; i++) {
+    if (ret == GS_OK)
+      *query.fields[i]->result = query.memory[i];
+    else
+      free(query.memory[i]);
+  }
+
+  if (ret == GS_OK && mode_list != NULL) {
+    *mode_list = (PDISPLAY_MODE) modes.data;
+  } else {
+    PDISPLAY_MODE mode = (PDISPLAY_MODE) modes.data;
+    while (mode != NULL) {
+      PDISPLAY_MODE next = mode->next;
+      free(mode);
+      mode = next;
+    }
+  }
+
+  return ret;
+}
+
 int xml_applist(char* data, size_t len, PAPP_LIST *app_list) {
   struct xml_query query;
   query.memory = calloc(1, 1);
@@ -33,7 +33,13 @@ typedef struct _DISPLAY_MODE {
   struct _DISPLAY_MODE *next;
 } DISPLAY_MODE, *PDISPLAY_MODE;
 
+typedef struct _XML_FIELD {
+  const char* node;
+  char** result;
+} XML_FIELD, *PXML_FIELD;
+
 int xml_search(char* data, size_t len, char* node, char** result);
+int xml_search_fields(char* data, size_t len, PXML_FIELD fields, int count, PDISPLAY_MODE *mode_list);
 int xml_applist(char* data, size_t len, PAPP_LIST *app_list);
 int xml_modelist(char* data, size_t len, PDISPLAY_MODE *mode_list);
 int xml_status(char* data, size_t len);
@@ -42,6 +42,8 @@ extern AUDIO_RENDERER_CALLBACKS audio_callbacks_oss;
 #endif
 #ifdef __3DS__
 extern bool n3ds_audio_disabled;
+extern int n3ds_audio_latency_ms;
+extern bool n3ds_audio_low_latency;
 extern AUDIO_RENDERER_CALLBACKS audio_callbacks_n3ds;
 #endif
 
@@ -0,0 +1,98 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioJitterBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Weight of each new queue depth in the running average
+#define JITTER_AVG_WEIGHT 0.125f
+// Rate correction per second of latency error, about a 10 second time constant
+#define JITTER_RATE_GAIN 0.1f
+// Removes the steady offset a constant drift leaves, critically damped
+#define JITTER_DRIFT_GAIN (JITTER_RATE_GAIN * JITTER_RATE_GAIN / 4)
+// Largest rate change, 0.5% is well below an audible pitch shift
+#define JITTER_MAX_RATE_ADJUST 0.005f
+// Smallest rate change worth applying to the channel, in Hz
+#define JITTER_RATE_STEP 0.5f
+
+AudioJitterBuffer::AudioJitterBuffer(int sample_rate_in, int target_samples_in,
+                                     int capacity_samples_in)
+    : target_samples(target_samples_in), sample_rate(sample_rate_in),
+      capacity_samples(capacity_samples_in), playback_rate(sample_rate_in),
+      applied_rate(sample_rate_in) {}
+
+AudioJitterBuffer::Action AudioJitterBuffer::on_packet(int queued_samples,
+                                                       int packet_samples) {
+    if (queued_samples == 0 && started && !hold) {
+        // Ran dry, let a full target's worth build up again before resuming
+        // instead of playing each packet the moment it arrives
+        underruns++;
+        hold = true;
+    }
+    started = true;
+
+    if (hold) {
+        if (queued_samples + packet_samples >= target_samples) {
+            hold = false;
+            queued_avg = target_samples;
+        }
+        return JITTER_PLAY;
+    }
+
+    queued_avg += (queued_samples - queued_avg) * JITTER_AVG_WEIGHT;
+
+    // Bursts beyond the headroom above the target are skipped outright, the
+    // rate correction is far too slow to absorb them
+    int high_water = target_samples + std::max(target_samples / 2,
+                                               packet_samples * 2);
+    high_water = std::min(high_water, capacity_samples - packet_samples);
+    if (queued_samples + packet_samples > high_water) {
+        drops++;
+        return JITTER_DROP;
+    }
+
+    // Play faster while ahead of the target and slower while behind
+    float error_seconds = (queued_avg - target_samples) / sample_rate;
+    drift += error_seconds * JITTER_DRIFT_GAIN * packet_samples / sample_rate;
+    drift = std::max(-JITTER_MAX_RATE_ADJUST,
+                     std::min(JITTER_MAX_RATE_ADJUST, drift));
+    float adjust = std::max(-JITTER_MAX_RATE_ADJUST,
+                            std::min(JITTER_MAX_RATE_ADJUST,
+                                     error_seconds * JITTER_RATE_GAIN + drift));
+    playback_rate = sample_rate * (1.0f + adjust);
+    return JITTER_PLAY;
+}
+
+void AudioJitterBuffer::resize(int target_samples_in,
+                               int capacity_samples_in) {
+    target_samples = target_samples_in;
+    capacity_samples = capacity_samples_in;
+}
+
+bool AudioJitterBuffer::holding() { return hold; }
+
+float AudioJitterBuffer::rate() { return playback_rate; }
+
+bool AudioJitterBuffer::take_rate_change() {
+    if (std::fabs(playback_rate - applied_rate) < JITTER_RATE_STEP) {
+        return false;
+    }
+    applied_rate = playback_rate;
+    return true;
+}
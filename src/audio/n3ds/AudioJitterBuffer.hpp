@@ -0,0 +1,66 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the control loop can be simulated on the host.
+
+#include <cstdint>
+
+// Keeps the audio queued for playback near a target latency. Network jitter
+// is absorbed by the queue, the slow drift between the host's and the DSP's
+// sample clocks is corrected by nudging the playback rate.
+class AudioJitterBuffer {
+  public:
+    enum Action {
+        // Queue the packet for playback
+        JITTER_PLAY,
+        // The queue is too far ahead of the target, skip the packet
+        JITTER_DROP,
+    };
+
+    AudioJitterBuffer(int sample_rate_in, int target_samples_in,
+                      int capacity_samples_in);
+
+    // Called for every packet with the samples still waiting to be played
+    Action on_packet(int queued_samples, int packet_samples);
+
+    // Playback should stay paused while the queue refills after running dry
+    bool holding();
+    // Rate the channel should play at, in Hz
+    float rate();
+    // True once when rate() has moved far enough to be worth applying
+    bool take_rate_change();
+    // Moves the target, e.g. after more buffers were made available
+    void resize(int target_samples_in, int capacity_samples_in);
+
+  public:
+    int target_samples;
+    uint64_t underruns = 0;
+    uint64_t drops = 0;
+
+  private:
+    int sample_rate;
+    int capacity_samples;
+    bool started = false;
+    bool hold = true;
+    float queued_avg = 0;
+    // Learned clock difference, as a fraction of the sample rate
+    float drift = 0;
+    float playback_rate;
+    float applied_rate;
+};
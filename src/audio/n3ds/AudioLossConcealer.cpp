@@ -0,0 +1,44 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioLossConcealer.hpp"
+
+AudioLossConcealer::AudioLossConcealer(int max_deferred_in)
+    : max_deferred(max_deferred_in) {}
+
+int AudioLossConcealer::on_lost() {
+    pending_lost++;
+    if (pending_lost <= max_deferred) {
+        return 0;
+    }
+    // Only the newest loss can be recovered from the next packet
+    pending_lost--;
+    concealed++;
+    return 1;
+}
+
+AudioLossPlan AudioLossConcealer::on_packet() {
+    AudioLossPlan plan = {0, false};
+    if (pending_lost > 0) {
+        plan.plc_frames = pending_lost - 1;
+        plan.fec_frame = true;
+        concealed += plan.plc_frames;
+        recovered++;
+        pending_lost = 0;
+    }
+    return plan;
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so packet loss patterns can be replayed on the host.
+
+#include <cstdint>
+
+// How to fill in for lost packets when the next packet arrives
+struct AudioLossPlan {
+    // Frames to synthesize with packet loss concealment
+    int plc_frames;
+    // Recover the frame just before the packet from its in-band FEC data
+    bool fec_frame;
+};
+
+// Decides how lost packets are concealed. The most recent loss is held back
+// until the next packet arrives so it can be rebuilt from that packet's FEC
+// data, anything older is concealed right away to keep the queue fed.
+class AudioLossConcealer {
+  public:
+    explicit AudioLossConcealer(int max_deferred_in = 1);
+
+    // Called when a packet was lost or arrived too late to be played.
+    // Returns the number of frames to conceal now.
+    int on_lost();
+    // Called for every packet that arrived
+    AudioLossPlan on_packet();
+
+  public:
+    uint64_t concealed = 0;
+    // Frames decoded with FEC. Opus falls back to concealment by itself when
+    // the packet turns out not to carry any.
+    uint64_t recovered = 0;
+
+  private:
+    int max_deferred;
+    int pending_lost = 0;
+};
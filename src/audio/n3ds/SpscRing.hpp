@@ -0,0 +1,81 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so it can be built and exercised on the host.
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free ring between exactly one producer thread and one consumer thread.
+// Items are written and read in place, so large items are never copied
+// through the ring. Neither side ever blocks, the caller decides how to wait
+// for space or data.
+template <typename T> class SpscRing {
+  public:
+    explicit SpscRing(size_t min_capacity) : slots(round_up(min_capacity)) {
+        mask = slots.size() - 1;
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    // Producer side. Returns nullptr while the ring is full.
+    T *begin_write() {
+        size_t head = write_idx.load(std::memory_order_relaxed);
+        if (head - read_idx.load(std::memory_order_acquire) == slots.size()) {
+            return nullptr;
+        }
+        return &slots[head & mask];
+    }
+
+    void end_write() {
+        write_idx.store(write_idx.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+    }
+
+    // Consumer side. Returns nullptr while the ring is empty.
+    T *begin_read() {
+        size_t tail = read_idx.load(std::memory_order_relaxed);
+        if (write_idx.load(std::memory_order_acquire) == tail) {
+            return nullptr;
+        }
+        return &slots[tail & mask];
+    }
+
+    void end_read() {
+        read_idx.store(read_idx.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_release);
+    }
+
+  private:
+    static size_t round_up(size_t n) {
+        size_t capacity = 1;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+  private:
+    std::vector<T> slots;
+    size_t mask;
+    // Each index is only written by one side, keep them on separate lines
+    alignas(64) std::atomic<size_t> write_idx{0};
+    alignas(64) std::atomic<size_t> read_idx{0};
+};
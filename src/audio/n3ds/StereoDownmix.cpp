@@ -0,0 +1,54 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StereoDownmix.hpp"
+
+#if defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+// Q15 gains. The whole mix is attenuated by 1 / (1 + 0.707) so typical game
+// mixes stay clear of clipping, peaks beyond that are saturated.
+#define DOWNMIX_FRONT 19195    // 0.586
+#define DOWNMIX_SURROUND 13573 // 0.707 * 0.586
+
+static inline int16_t saturate16(int32_t x) {
+#if defined(__ARM_FEATURE_SAT)
+    return __ssat(x, 16);
+#else
+    return x < INT16_MIN ? INT16_MIN : (x > INT16_MAX ? INT16_MAX : x);
+#endif
+}
+
+void downmix_to_stereo(const int16_t *in, int channels, int frames,
+                       int16_t *out) {
+    for (int i = 0; i < frames; i++, in += channels, out += 2) {
+        int32_t left = in[0] * DOWNMIX_FRONT;
+        int32_t right = in[1] * DOWNMIX_FRONT;
+        if (channels == 6 || channels == 8) {
+            int32_t centre = in[2] * DOWNMIX_SURROUND;
+            left += centre + in[4] * DOWNMIX_SURROUND;
+            right += centre + in[5] * DOWNMIX_SURROUND;
+        }
+        if (channels == 8) {
+            left += in[6] * DOWNMIX_SURROUND;
+            right += in[7] * DOWNMIX_SURROUND;
+        }
+        out[0] = saturate16(left >> 15);
+        out[1] = saturate16(right >> 15);
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the kernel can be checked and benchmarked on the
+// host.
+
+#include <cstdint>
+
+// Folds interleaved surround PCM in the order FL-FR-C-LFE-RL-RR(-SL-SR) down
+// to interleaved stereo. Centre and surround channels are mixed in at -3 dB
+// and LFE is dropped, the usual ITU-R BS.775 fold-down. in and out may not
+// overlap. Channel counts other than 6 and 8 keep only the front pair.
+void downmix_to_stereo(const int16_t *in, int channels, int frames,
+                       int16_t *out);
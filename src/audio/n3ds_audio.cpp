@@ -18,24 +18,73 @@
  */
 
 #include "audio.h"
+#include "n3ds/AudioJitterBuffer.hpp"
+#include "n3ds/AudioLossConcealer.hpp"
+#include "n3ds/SpscRing.hpp"
+#include "n3ds/StereoDownmix.hpp"
+
+#include "../n3ds/n3ds_thread.hpp"
+#include "../n3ds/perf_stats.hpp"
 
 #include <3ds.h>
+#include <atomic>
 #include <math.h>
+#include <memory>
 #include <opus/opus_multistream.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define WAVEBUF_SIZE 16
+// Low latency mode starts from the fewest buffers that keep two frames
+// queued, and adds more each time playback runs dry
+#define WAVEBUF_LOW_LATENCY_COUNT 4
+#define WAVEBUF_GROWTH 2
+// Compressed packets waiting for the audio thread, well over the wavebufs
+#define AUDIO_PACKET_RING_SIZE 32
+// Larger than any packet that fits in one datagram
+#define AUDIO_MAX_PACKET_SIZE 1500
 bool n3ds_audio_disabled = false;
+int n3ds_audio_latency_ms = 50;
+bool n3ds_audio_low_latency = false;
 
 static OpusMSDecoder* decoder;
 static u8* audioBuffer;
+// Full channel decode of a surround packet before it is folded to stereo
+static opus_int16* surroundBuffer;
 static int samplesPerFrame;
 static int sampleRate;
 static int channelCount;
 static ndspWaveBuf audio_wave_buf[WAVEBUF_SIZE];
 static int wave_buf_idx = 0;
+// Wavebufs in rotation, all of them unless in low latency mode
+static int wave_buf_count = WAVEBUF_SIZE;
+static u64 last_underruns = 0;
+static std::unique_ptr<AudioJitterBuffer> jitter_buffer = nullptr;
+static std::unique_ptr<AudioLossConcealer> loss_concealer = nullptr;
+
+// Packets are decoded on their own thread, the receive thread only copies
+// them into the ring
+struct AudioPacket {
+  // Negative for a packet that was lost
+  int length;
+  unsigned char data[AUDIO_MAX_PACKET_SIZE];
+};
+static std::unique_ptr<SpscRing<AudioPacket>> packet_ring = nullptr;
+static LightEvent packet_event;
+static std::atomic<bool> audio_thread_running(false);
+static Thread audio_thread = NULL;
+static u64 packets_overflowed = 0;
+
+static void audio_thread_main(void* arg);
+
+// Leave room for at least two packets either side of the target
+static int jitter_target(int target) {
+  int capacity = samplesPerFrame * wave_buf_count;
+  target = target < samplesPerFrame * 2 ? samplesPerFrame * 2 : target;
+  target = target > capacity - samplesPerFrame * 2 ? capacity - samplesPerFrame * 2 : target;
+  return target;
+}
 
 static int n3ds_renderer_init(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* context, int arFlags) {
   int rc;
@@ -44,7 +93,13 @@ static int n3ds_renderer_init(int audioConfiguration, POPUS_MULTISTREAM_CONFIGUR
   sampleRate = opusConfig->sampleRate;
   channelCount = opusConfig->channelCount;
   samplesPerFrame = opusConfig->samplesPerFrame;
-  int bytes_per_frame = sizeof(short) * channelCount * samplesPerFrame;
+  // The DSP always plays stereo, surround streams are downmixed
+  int bytes_per_frame = sizeof(short) * 2 * samplesPerFrame;
+  if (channelCount > 2) {
+    surroundBuffer = (opus_int16*)malloc(sizeof(opus_int16) * channelCount * samplesPerFrame);
+    if (surroundBuffer == NULL)
+      return -1;
+  }
 
   if(ndspInit() != 0)
   {
@@ -52,7 +107,7 @@ static int n3ds_renderer_init(int audioConfiguration, POPUS_MULTISTREAM_CONFIGUR
     return -1;
   }
 
-  u8 *audioBuffer = (u8*)linearAlloc(bytes_per_frame * WAVEBUF_SIZE);
+  audioBuffer = (u8*)linearAlloc(bytes_per_frame * WAVEBUF_SIZE);
   if (audioBuffer == NULL)
     return -1;
   memset(audioBuffer, 0, bytes_per_frame * WAVEBUF_SIZE);
@@ -74,13 +129,46 @@ static int n3ds_renderer_init(int audioConfiguration, POPUS_MULTISTREAM_CONFIGUR
     audio_wave_buf[i].data_vaddr = &audioBuffer[i * bytes_per_frame];
     audio_wave_buf[i].status = NDSP_WBUF_DONE;
   }
+  wave_buf_idx = 0;
+  wave_buf_count = n3ds_audio_low_latency ? WAVEBUF_LOW_LATENCY_COUNT : WAVEBUF_SIZE;
+  last_underruns = 0;
+
+  int target = n3ds_audio_low_latency ? 0 : sampleRate * n3ds_audio_latency_ms / 1000;
+  jitter_buffer = std::make_unique<AudioJitterBuffer>(sampleRate, jitter_target(target), samplesPerFrame * wave_buf_count);
+  loss_concealer = std::make_unique<AudioLossConcealer>();
+
+  // Unpaused once the queue has filled up to the target
+  ndspChnSetPaused(0, true);
 
-  ndspChnSetPaused(0, false);
+  packet_ring = std::make_unique<SpscRing<AudioPacket>>(AUDIO_PACKET_RING_SIZE);
+  packets_overflowed = 0;
+  LightEvent_Init(&packet_event, RESET_ONESHOT);
+  audio_thread_running = true;
+  // Ahead of the video present thread that may share the core
+  audio_thread = n3ds_thread_create(audio_thread_main, NULL, N3DS_EXTRA_CORE, -1);
+  if (audio_thread == NULL) {
+    fprintf(stderr, "Failed to start the audio thread\n");
+    audio_thread_running = false;
+    return -1;
+  }
 
   return 0;
 }
 
 static void n3ds_renderer_cleanup() {
+  if (audio_thread != NULL) {
+    audio_thread_running = false;
+    LightEvent_Signal(&packet_event);
+    threadJoin(audio_thread, U64_MAX);
+    threadFree(audio_thread);
+    audio_thread = NULL;
+  }
+  if (packet_ring) {
+    if (packets_overflowed)
+      printf("Audio: %llu packets dropped, decoding fell behind\n", packets_overflowed);
+    packet_ring = nullptr;
+  }
+
   if (decoder != NULL) {
     opus_multistream_decoder_destroy(decoder);
     decoder = NULL;
@@ -89,26 +177,142 @@ static void n3ds_renderer_cleanup() {
   ndspChnWaveBufClear(0);
   ndspExit();
   if (audioBuffer != NULL) {
-    free(audioBuffer);
+    linearFree(audioBuffer);
     audioBuffer = NULL;
   }
+  if (surroundBuffer != NULL) {
+    free(surroundBuffer);
+    surroundBuffer = NULL;
+  }
+
+  if (jitter_buffer) {
+    printf("Audio: %llu underruns, %llu packets skipped, rate %.1f Hz\n",
+           jitter_buffer->underruns, jitter_buffer->drops, jitter_buffer->rate());
+    if (n3ds_audio_low_latency)
+      printf("Audio: settled on %d buffers, %d ms\n", wave_buf_count,
+             wave_buf_count * samplesPerFrame * 1000 / sampleRate);
+    jitter_buffer = nullptr;
+  }
+  if (loss_concealer) {
+    printf("Audio: %llu frames concealed, %llu decoded with FEC\n",
+           loss_concealer->concealed, loss_concealer->recovered);
+    loss_concealer = nullptr;
+  }
 }
 
-static void n3ds_renderer_decode_and_play_sample(char* data, int length) {
-  if (n3ds_audio_disabled || (audio_wave_buf[wave_buf_idx].status != NDSP_WBUF_DONE)) {
+// Samples submitted to the DSP that have not been played yet
+static int queued_samples() {
+  int queued = 0;
+  bool playing = false;
+  for (int i = 0; i < WAVEBUF_SIZE; i++) {
+    if (audio_wave_buf[i].status == NDSP_WBUF_QUEUED || audio_wave_buf[i].status == NDSP_WBUF_PLAYING) {
+      queued += audio_wave_buf[i].nsamples;
+      playing |= audio_wave_buf[i].status == NDSP_WBUF_PLAYING;
+    }
+  }
+  if (playing)
+    queued -= ndspChnGetSamplePos(0);
+  return queued > 0 ? queued : 0;
+}
+
+// Running dry means the queue was too short for the jitter on this network.
+// Buffers past the old count are idle, so the rotation can simply extend
+// over them, the queue refills to the new target before playback resumes.
+static void grow_wave_bufs() {
+  last_underruns = jitter_buffer->underruns;
+  if (wave_buf_count >= WAVEBUF_SIZE)
+    return;
+  wave_buf_count += WAVEBUF_GROWTH;
+  if (wave_buf_count > WAVEBUF_SIZE)
+    wave_buf_count = WAVEBUF_SIZE;
+  jitter_buffer->resize(jitter_target(samplesPerFrame * (wave_buf_count - 2)), samplesPerFrame * wave_buf_count);
+}
+
+// Decodes one frame into the next wavebuf. A NULL packet conceals a lost
+// frame, decode_fec rebuilds the frame before the packet from its FEC data.
+static void play_frame(const unsigned char* data, int length, int decode_fec) {
+  int queued = queued_samples();
+  perf_stats_record(PERF_STAT_AUDIO_QUEUE, queued * 1000 / sampleRate);
+  if (jitter_buffer->on_packet(queued, samplesPerFrame) == AudioJitterBuffer::JITTER_DROP) {
+    return;
+  }
+  if (n3ds_audio_low_latency && jitter_buffer->underruns != last_underruns) {
+    grow_wave_bufs();
+  }
+  if (jitter_buffer->take_rate_change()) {
+    ndspChnSetRate(0, jitter_buffer->rate());
+  }
+  if (audio_wave_buf[wave_buf_idx].status != NDSP_WBUF_DONE) {
+    // Every buffer is still queued
+    jitter_buffer->drops++;
     return;
   }
 
-  int decodeLen = opus_multistream_decode(decoder, (const unsigned char *)data, length, (opus_int16 *)audio_wave_buf[wave_buf_idx].data_vaddr, samplesPerFrame, 0);
+  opus_int16* pcm = (opus_int16 *)audio_wave_buf[wave_buf_idx].data_vaddr;
+  int decodeLen = opus_multistream_decode(decoder, data, length, surroundBuffer ? surroundBuffer : pcm, samplesPerFrame, decode_fec);
   if (decodeLen < 0) {
     fprintf(stderr, "Opus error from decode: %d\n", decodeLen);
     return;
   }
-  DSP_FlushDataCache(audio_wave_buf[wave_buf_idx].data_vaddr, decodeLen * channelCount * sizeof(short));
+  if (surroundBuffer)
+    downmix_to_stereo(surroundBuffer, channelCount, decodeLen, pcm);
+  DSP_FlushDataCache(pcm, decodeLen * 2 * sizeof(short));
   audio_wave_buf[wave_buf_idx].nsamples = decodeLen;
   ndspChnWaveBufAdd(0, &audio_wave_buf[wave_buf_idx]);
 
-  wave_buf_idx = (wave_buf_idx +  1) % WAVEBUF_SIZE;
+  wave_buf_idx = (wave_buf_idx +  1) % wave_buf_count;
+
+  ndspChnSetPaused(0, jitter_buffer->holding());
+}
+
+static void decode_packet(const unsigned char* data, int length) {
+  // Lost and late packets are reported without data
+  if (data == NULL) {
+    if (loss_concealer->on_lost())
+      play_frame(NULL, 0, 0);
+    return;
+  }
+
+  AudioLossPlan plan = loss_concealer->on_packet();
+  for (int i = 0; i < plan.plc_frames; i++)
+    play_frame(NULL, 0, 0);
+  if (plan.fec_frame)
+    play_frame(data, length, 1);
+  play_frame(data, length, 0);
+}
+
+static void audio_thread_main(void* arg) {
+  while (audio_thread_running) {
+    AudioPacket* packet;
+    while ((packet = packet_ring->begin_read()) != nullptr) {
+      if (packet->length < 0)
+        decode_packet(NULL, 0);
+      else
+        decode_packet(packet->data, packet->length);
+      packet_ring->end_read();
+    }
+    LightEvent_Wait(&packet_event);
+  }
+}
+
+static void n3ds_renderer_decode_and_play_sample(char* data, int length) {
+  if (n3ds_audio_disabled) {
+    return;
+  }
+
+  AudioPacket* packet = packet_ring->begin_write();
+  if (packet == nullptr) {
+    packets_overflowed++;
+    return;
+  }
+  if (data == NULL || length > AUDIO_MAX_PACKET_SIZE) {
+    packet->length = -1;
+  } else {
+    packet->length = length;
+    memcpy(packet->data, data, length);
+  }
+  packet_ring->end_write();
+  LightEvent_Signal(&packet_event);
 }
 
 AUDIO_RENDERER_CALLBACKS audio_callbacks_n3ds = {
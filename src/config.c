@@ -90,6 +90,20 @@ static struct option long_options[] = {
   {"swapfacebuttons", required_argument, NULL, 'A'},
   {"swaptriggersandshoulders", required_argument, NULL, 'B'},
   {"usetriggersformouse", required_argument, NULL, 'C'},
+  {"audio_latency", required_argument, NULL, 'D'},
+  {"audio_low_latency", required_argument, NULL, 'E'},
+  {"input_poll_rate", required_argument, NULL, 'F'},
+  {"circlepad_range", required_argument, NULL, 'G'},
+  {"cstick_range", required_argument, NULL, 'H'},
+  {"stick_deadzone", required_argument, NULL, 'I'},
+  {"stick_axial_deadzone", required_argument, NULL, 'J'},
+  {"stick_anti_deadzone", required_argument, NULL, 'K'},
+  {"stick_curve", required_argument, NULL, 'L'},
+  {"accel_range", required_argument, NULL, 'M'},
+  {"gyro_aim", required_argument, NULL, 'N'},
+  {"gyro_aim_sensitivity", required_argument, NULL, 'O'},
+  {"gyro_ratchet_button", required_argument, NULL, 'Q'},
+  {"key_type", required_argument, NULL, 'P'},
   {0, 0, 0, 0},
 };
 
@@ -305,6 +319,48 @@ void parse_argument(int c, char* value, PCONFIGURATION config) {
   case 'C':
     config->use_triggers_for_mouse = ((value != NULL) && (strcmp(value, "true") == 0));
     break;
+  case 'D':
+    config->audio_latency = atoi(value);
+    break;
+  case 'E':
+    config->audio_low_latency = ((value != NULL) && (strcmp(value, "true") == 0));
+    break;
+  case 'F':
+    config->input_poll_rate = atoi(value);
+    break;
+  case 'G':
+    config->circlepad_range = atoi(value);
+    break;
+  case 'H':
+    config->cstick_range = atoi(value);
+    break;
+  case 'I':
+    config->stick_deadzone = atoi(value);
+    break;
+  case 'J':
+    config->stick_axial_deadzone = atoi(value);
+    break;
+  case 'K':
+    config->stick_anti_deadzone = atoi(value);
+    break;
+  case 'L':
+    config->stick_curve = atoi(value);
+    break;
+  case 'M':
+    config->accel_range = atoi(value);
+    break;
+  case 'N':
+    config->gyro_aim = ((value != NULL) && (strcmp(value, "true") == 0));
+    break;
+  case 'O':
+    config->gyro_aim_sensitivity = atoi(value);
+    break;
+  case 'P':
+    config->key_type = value;
+    break;
+  case 'Q':
+    config->gyro_ratchet_button = value;
+    break;
   case 1:
     if (config->action == NULL)
       config->action = value;
@@ -372,6 +428,24 @@ void config_save(char* filename, PCONFIGURATION config) {
   write_config_bool(fd, "debug", config->debug_level);
   write_config_int(fd, "display_type", config->display_type);
   write_config_bool(fd, "motion_controls", config->motion_controls);
+  write_config_int(fd, "audio_latency", config->audio_latency);
+  write_config_bool(fd, "audio_low_latency", config->audio_low_latency);
+  write_config_int(fd, "input_poll_rate", config->input_poll_rate);
+  write_config_int(fd, "circlepad_range", config->circlepad_range);
+  write_config_int(fd, "cstick_range", config->cstick_range);
+  write_config_int(fd, "stick_deadzone", config->stick_deadzone);
+  write_config_int(fd, "stick_axial_deadzone", config->stick_axial_deadzone);
+  write_config_int(fd, "stick_anti_deadzone", config->stick_anti_deadzone);
+  write_config_int(fd, "stick_curve", config->stick_curve);
+  write_config_int(fd, "accel_range", config->accel_range);
+  write_config_bool(fd, "gyro_aim", config->gyro_aim);
+  write_config_int(fd, "gyro_aim_sensitivity", config->gyro_aim_sensitivity);
+  write_config_string(fd, "gyro_ratchet_button", config->gyro_ratchet_button);
+  write_config_string(fd, "key_type", config->key_type);
+  if (config->stream.audioConfiguration == AUDIO_CONFIGURATION_51_SURROUND)
+    write_config_string(fd, "surround", "5.1");
+  else if (config->stream.audioConfiguration == AUDIO_CONFIGURATION_71_SURROUND)
+    write_config_string(fd, "surround", "7.1");
 
   if (strcmp(config->app, "Steam") != 0)
     write_config_string(fd, "app", config->app);
@@ -406,6 +480,8 @@ void config_parse(int argc, char* argv[], PCONFIGURATION config) {
 
   config->debug_level = 0;
   config->platform = "auto";
+  config->key_type = "rsa2048";
+  config->gyro_ratchet_button = "zl";
   config->app = "Steam";
   config->action = NULL;
   config->address = NULL;
@@ -439,6 +515,18 @@ void config_parse(int argc, char* argv[], PCONFIGURATION config) {
   config->swap_face_buttons = false;
   config->swap_triggers_and_shoulders = false;
   config->use_triggers_for_mouse = false;
+  config->audio_latency = 50;
+  config->audio_low_latency = false;
+  config->input_poll_rate = 250;
+  config->circlepad_range = 150;
+  config->cstick_range = 100;
+  config->stick_deadzone = 0;
+  config->stick_axial_deadzone = 0;
+  config->stick_anti_deadzone = 0;
+  config->stick_curve = 100;
+  config->accel_range = 510;
+  config->gyro_aim = false;
+  config->gyro_aim_sensitivity = 10;
 
   char* config_file = (char*) MOONLIGHT_3DS_PATH "/moonlight.conf";
   if (config_file)
@@ -61,6 +61,20 @@ typedef struct _CONFIGURATION {
   bool swap_face_buttons;
   bool swap_triggers_and_shoulders;
   bool use_triggers_for_mouse;
+  int audio_latency;
+  bool audio_low_latency;
+  int input_poll_rate;
+  int circlepad_range;
+  int cstick_range;
+  int stick_deadzone;
+  int stick_axial_deadzone;
+  int stick_anti_deadzone;
+  int stick_curve;
+  int accel_range;
+  bool gyro_aim;
+  int gyro_aim_sensitivity;
+  char* gyro_ratchet_button;
+  char* key_type;
 } CONFIGURATION, *PCONFIGURATION;
 
 extern bool inputAdded;
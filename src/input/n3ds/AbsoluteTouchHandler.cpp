@@ -17,22 +17,23 @@
  * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "N3dsInputBatch.hpp"
 #include "N3dsTouchscreenInput.hpp"
 #include <Limelight.h>
 
 void AbsoluteTouchHandler::_handle_touch_down(touchPosition touch) {
-    LiSendMousePositionEvent(touch.px, touch.py + y_offset,
-                             GSP_SCREEN_HEIGHT_BOTTOM,
-                             y_scale * GSP_SCREEN_WIDTH);
-    LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_LEFT);
+    n3ds_input_batch.mouse_position(touch.px, touch.py + y_offset,
+                                    GSP_SCREEN_HEIGHT_BOTTOM,
+                                    y_scale * GSP_SCREEN_WIDTH);
+    n3ds_input_batch.mouse_button(BUTTON_ACTION_PRESS, BUTTON_LEFT);
 }
 
 void AbsoluteTouchHandler::_handle_touch_up(touchPosition touch) {
-    LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, BUTTON_LEFT);
+    n3ds_input_batch.mouse_button(BUTTON_ACTION_RELEASE, BUTTON_LEFT);
 }
 
 void AbsoluteTouchHandler::_handle_touch_hold(touchPosition touch) {
-    LiSendMousePositionEvent(touch.px, touch.py + y_offset,
-                             GSP_SCREEN_HEIGHT_BOTTOM,
-                             y_scale * GSP_SCREEN_WIDTH);
+    n3ds_input_batch.mouse_position(touch.px, touch.py + y_offset,
+                                    GSP_SCREEN_HEIGHT_BOTTOM,
+                                    y_scale * GSP_SCREEN_WIDTH);
 }
@@ -0,0 +1,99 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GyroAim.hpp"
+
+#include <cmath>
+
+// Cutoff of the speed estimate that steers the one euro filter
+#define GYRO_DERIVATIVE_CUTOFF_HZ 1.0f
+
+static float smoothing_factor(float dt, float cutoff_hz) {
+    float tau = 1.0f / (2.0f * (float)M_PI * cutoff_hz);
+    return 1.0f / (1.0f + tau / dt);
+}
+
+float LowPassFilter::filter(float value, float dt, float cutoff_hz) {
+    if (!primed || dt <= 0) {
+        state = value;
+        primed = true;
+        return state;
+    }
+    state += smoothing_factor(dt, cutoff_hz) * (value - state);
+    return state;
+}
+
+void LowPassFilter::reset() { primed = false; }
+
+float LowPassFilter::last() { return state; }
+
+OneEuroFilter::OneEuroFilter(float min_cutoff_hz_in, float beta_in,
+                             float derivative_cutoff_hz_in)
+    : min_cutoff_hz(min_cutoff_hz_in), beta(beta_in),
+      derivative_cutoff_hz(derivative_cutoff_hz_in) {}
+
+float OneEuroFilter::filter(float value, float dt) {
+    float derivative = 0;
+    if (dt > 0) {
+        derivative = (value - value_filter.last()) / dt;
+    }
+    float speed = std::fabs(
+        derivative_filter.filter(derivative, dt, derivative_cutoff_hz));
+    return value_filter.filter(value, dt, min_cutoff_hz + beta * speed);
+}
+
+void OneEuroFilter::reset() {
+    value_filter.reset();
+    derivative_filter.reset();
+}
+
+GyroAim::GyroAim(const GyroAimSettings &settings_in)
+    : settings(settings_in),
+      yaw_filter(settings_in.min_cutoff_hz, settings_in.beta,
+                 GYRO_DERIVATIVE_CUTOFF_HZ),
+      pitch_filter(settings_in.min_cutoff_hz, settings_in.beta,
+                   GYRO_DERIVATIVE_CUTOFF_HZ) {}
+
+// Shrinks rather than cuts, so there is no jump at the edge of the band
+float GyroAim::apply_dead_band(float rate) {
+    if (std::fabs(rate) <= settings.dead_band_dps) {
+        return 0;
+    }
+    return rate > 0 ? rate - settings.dead_band_dps
+                    : rate + settings.dead_band_dps;
+}
+
+void GyroAim::update(float yaw_dps, float pitch_dps, float dt, bool ratchet,
+                     int *dx, int *dy) {
+    *dx = 0;
+    *dy = 0;
+    float yaw = apply_dead_band(yaw_filter.filter(yaw_dps, dt));
+    float pitch = apply_dead_band(pitch_filter.filter(pitch_dps, dt));
+    if (ratchet || dt <= 0) {
+        remainder_x = 0;
+        remainder_y = 0;
+        return;
+    }
+
+    // Turning left and tilting up are positive, the cursor moves left and up
+    remainder_x -= yaw * dt * settings.pixels_per_degree;
+    remainder_y -= pitch * dt * settings.pixels_per_degree;
+    *dx = (int)remainder_x;
+    *dy = (int)remainder_y;
+    remainder_x -= *dx;
+    remainder_y -= *dy;
+}
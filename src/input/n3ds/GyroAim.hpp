@@ -0,0 +1,84 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the filtering can be tuned against recorded gyro
+// traces on the host.
+
+// First order low-pass, parameterized by cutoff so it follows a varying
+// sample interval
+class LowPassFilter {
+  public:
+    float filter(float value, float dt, float cutoff_hz);
+    void reset();
+    float last();
+
+  private:
+    float state = 0;
+    bool primed = false;
+};
+
+// One euro filter (Casiez et al.). A low-pass whose cutoff rises with the
+// speed of the signal, so holding still is smoothed heavily while fast
+// movements keep little lag.
+class OneEuroFilter {
+  public:
+    OneEuroFilter(float min_cutoff_hz_in, float beta_in,
+                  float derivative_cutoff_hz_in);
+
+    float filter(float value, float dt);
+    void reset();
+
+  private:
+    float min_cutoff_hz;
+    float beta;
+    float derivative_cutoff_hz;
+    LowPassFilter value_filter;
+    LowPassFilter derivative_filter;
+};
+
+struct GyroAimSettings {
+    // Mouse movement for one degree of rotation
+    float pixels_per_degree;
+    // Rates below this are treated as hand tremor and dropped (deg/s)
+    float dead_band_dps;
+    float min_cutoff_hz;
+    float beta;
+};
+
+// Turns yaw and pitch rates into relative mouse movement. Fractions of a
+// pixel are carried over to the next update instead of being lost.
+class GyroAim {
+  public:
+    explicit GyroAim(const GyroAimSettings &settings_in);
+
+    // Rates in deg/s, dt in seconds. While ratchet is held the device can be
+    // turned back without moving the cursor.
+    void update(float yaw_dps, float pitch_dps, float dt, bool ratchet,
+                int *dx, int *dy);
+
+  private:
+    float apply_dead_band(float rate);
+
+  private:
+    GyroAimSettings settings;
+    OneEuroFilter yaw_filter;
+    OneEuroFilter pitch_filter;
+    float remainder_x = 0;
+    float remainder_y = 0;
+};
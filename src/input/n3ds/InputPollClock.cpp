@@ -0,0 +1,45 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InputPollClock.hpp"
+
+InputPollClock::InputPollClock(uint64_t period_in) : poll_period(period_in) {}
+
+uint64_t InputPollClock::on_poll(uint64_t now) {
+    if (polls++ == 0) {
+        deadline = now;
+    }
+    uint64_t late = now > deadline ? now - deadline : 0;
+    jitter_sum += late;
+    if (late > max_jitter) {
+        max_jitter = late;
+    }
+
+    deadline += poll_period;
+    if (deadline <= now) {
+        uint64_t behind = (now - deadline) / poll_period + 1;
+        missed += behind;
+        deadline += behind * poll_period;
+    }
+    return deadline;
+}
+
+uint64_t InputPollClock::period() { return poll_period; }
+
+uint64_t InputPollClock::average_jitter() {
+    return polls ? jitter_sum / polls : 0;
+}
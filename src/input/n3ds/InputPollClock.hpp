@@ -0,0 +1,47 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent, all times are in caller supplied ticks.
+
+#include <cstdint>
+
+// Schedules input polls on a fixed grid of deadlines, so the polling rate
+// doesn't drift with how long each poll takes, and measures how late the
+// polls actually start.
+class InputPollClock {
+  public:
+    explicit InputPollClock(uint64_t period_in);
+
+    // Called when a poll starts, returns the deadline of the next one. Polls
+    // that were missed entirely are skipped rather than run back to back.
+    uint64_t on_poll(uint64_t now);
+
+    uint64_t period();
+    uint64_t average_jitter();
+
+  public:
+    uint64_t polls = 0;
+    uint64_t max_jitter = 0;
+    uint64_t missed = 0;
+
+  private:
+    uint64_t poll_period;
+    uint64_t deadline = 0;
+    uint64_t jitter_sum = 0;
+};
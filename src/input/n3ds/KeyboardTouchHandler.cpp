@@ -17,6 +17,8 @@
  * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "../../video/n3ds/N3dsRenderer.hpp"
+#include "N3dsInputBatch.hpp"
 #include "N3dsTouchscreenInput.hpp"
 #include "keyboard_alt_bgr.h"
 #include "keyboard_bgr.h"
@@ -24,27 +26,229 @@
 #include "keyboard_shift_bgr.h"
 #include "keyboard_temp_bgr.h"
 #include <Limelight.h>
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 
+// Bounds the wait for queued copies before their buffers are freed, the same
+// time the renderers give the GPU before assuming completions were lost
+#define KEYBOARD_COPY_TIMEOUT_MS 100
+
+// Copies a whole keyboard layer with the transfer engine. Goes through the
+// renderers' job queue so it is ordered with the video frames, and is polled
+// for completion instead of waited on.
+class KeyboardLayerCopy : public GpuJobTarget {
+  public:
+    void start_tile(const GpuJob &job) {}
+    void start_draw(const GpuJob &job) {}
+    int present_transfer_count(const GpuJob &job) { return 1; }
+    void start_present(const GpuJob &job, int transfer) {
+        GX_TextureCopy((u32 *)job.source, 0, (u32 *)dest, 0, size,
+                       GX_TRANSFER_RAW_COPY(1));
+    }
+    void finish(const GpuJob &job) { completed = true; }
+
+    // Returns false if no renderer is running or the queue is full
+    bool start(const void *source, void *dest_in, u32 size_in) {
+        dest = dest_in;
+        size = size_in;
+        completed = false;
+        return N3dsRendererBase::queue_foreign_transfer(this, source);
+    }
+    bool idle() const {
+        return N3dsRendererBase::foreign_transfer_idle(this, 0);
+    }
+    // Only meaningful once idle, false if a queue reset dropped the copy
+    bool done() const { return completed; }
+
+  private:
+    void *dest = nullptr;
+    u32 size = 0;
+    std::atomic<bool> completed{false};
+};
+
+// Copies may still be queued after the handler that started them is gone
+static KeyboardLayerCopy screen_copy;
+static KeyboardLayerCopy default_upload;
+static KeyboardLayerCopy alt_upload;
+
 KeyboardTouchHandler::KeyboardTouchHandler()
     : selected_keycodes(&default_keycodes) {
 
     GSPGPU_FramebufferFormat px_fmt_btm = gfxGetScreenFormat(GFX_BOTTOM);
     key_px_size = gspGetBytesPerPixel(px_fmt_btm);
 
+    default_layer.bgr_buffer = keyboard_bgr;
+    default_layer.bgr_size = keyboard_bgr_size;
+    default_layer.upload = &default_upload;
+    alt_layer.bgr_buffer = keyboard_alt_bgr;
+    alt_layer.bgr_size = keyboard_alt_bgr_size;
+    alt_layer.upload = &alt_upload;
+
     handle_default();
 }
 
-void KeyboardTouchHandler::set_screen(const uint8_t *bgr_buffer, int bgr_size) {
+KeyboardTouchHandler::~KeyboardTouchHandler() {
+    // The next handler draws into the same framebuffer
+    N3dsRendererBase::foreign_transfer_idle(&screen_copy,
+                                            KEYBOARD_COPY_TIMEOUT_MS);
+    free_layer(default_layer);
+    free_layer(alt_layer);
+}
+
+// Layers are moved to VRAM while a renderer is running, since the copy has to
+// be ordered with its frames. Called on every poll, one step at a time: the
+// default layer first, the alt layer once it landed. Until then, and if VRAM
+// runs out, the screen is drawn from the executable image.
+void KeyboardTouchHandler::upload_layer(KeyboardLayer &layer) {
+    if (layer.in_vram || layer.no_vram) {
+        return;
+    }
+
+    if (layer.upload_queued) {
+        if (!layer.upload->idle()) {
+            return;
+        }
+        layer.upload_queued = false;
+        if (layer.upload->done()) {
+            linearFree(layer.staging);
+            layer.staging = nullptr;
+            layer.in_vram = true;
+        }
+        // A dropped upload is queued again on a later poll
+        return;
+    }
+
+    if (!N3dsRendererBase::gpu_queue_running()) {
+        return;
+    }
+    if (!layer.data) {
+        layer.data = vramAlloc(layer.bgr_size);
+        if (!layer.data) {
+            layer.no_vram = true;
+            return;
+        }
+    }
+    if (!layer.staging) {
+        // The transfer engine can't read the layers from the executable image
+        layer.staging = linearAlloc(layer.bgr_size);
+        if (!layer.staging) {
+            return;
+        }
+        memcpy(layer.staging, layer.bgr_buffer, layer.bgr_size);
+        GSPGPU_FlushDataCache(layer.staging, layer.bgr_size);
+    }
+    layer.upload_queued =
+        layer.upload->start(layer.staging, layer.data, layer.bgr_size);
+}
+
+void KeyboardTouchHandler::free_layer(KeyboardLayer &layer) {
+    // Still queued after the wait means completions were lost, leaving the
+    // buffers is safer than letting the GPU write into freed memory
+    if (layer.upload_queued &&
+        !N3dsRendererBase::foreign_transfer_idle(layer.upload,
+                                                 KEYBOARD_COPY_TIMEOUT_MS)) {
+        return;
+    }
+    if (layer.staging) {
+        linearFree(layer.staging);
+    }
+    if (layer.data) {
+        vramFree(layer.data);
+    }
+    layer.data = nullptr;
+    layer.staging = nullptr;
+    layer.upload_queued = false;
+    layer.in_vram = false;
+}
+
+void KeyboardTouchHandler::set_screen(KeyboardLayer &layer) {
+    shown_layer = &layer;
+    if (copied_layer) {
+        // finish_screen_copy draws the right layer once the copy is done
+        swap_pending = true;
+        return;
+    }
+
     u8 *gfxbtmadr = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+    if (layer.in_vram) {
+        // Cached key updates must not be written back over the copy
+        if (dirty_start >= 0) {
+            GSPGPU_FlushDataCache(gfxbtmadr + dirty_start,
+                                  dirty_end - dirty_start);
+            dirty_start = -1;
+        }
+        if (screen_copy.start(layer.data, gfxbtmadr, layer.bgr_size)) {
+            copied_layer = &layer;
+            swap_pending = true;
+            return;
+        }
+    }
+
+    // No renderer or the queue is full
+    memcpy(gfxbtmadr, layer.bgr_buffer, layer.bgr_size);
+    mark_dirty(0, layer.bgr_size);
+}
+
+// Returns false while the GPU still writes the framebuffer. Keys are drawn
+// over the layer once it landed, or the layer is drawn by the CPU if the copy
+// was dropped or another layer was picked meanwhile.
+bool KeyboardTouchHandler::finish_screen_copy() {
+    if (!copied_layer) {
+        return true;
+    }
+    if (!screen_copy.idle()) {
+        return false;
+    }
+
+    u8 *gfxbtmadr = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+    if (screen_copy.done() && copied_layer == shown_layer) {
+        GSPGPU_InvalidateDataCache(gfxbtmadr, shown_layer->bgr_size);
+    } else {
+        memcpy(gfxbtmadr, shown_layer->bgr_buffer, shown_layer->bgr_size);
+        mark_dirty(0, shown_layer->bgr_size);
+    }
+    copied_layer = nullptr;
+    draw_modifier_keys();
+    return true;
+}
 
-    memcpy(gfxbtmadr, bgr_buffer, bgr_size);
+void KeyboardTouchHandler::mark_dirty(int start, int end) {
+    if (dirty_start < 0) {
+        dirty_start = start;
+        dirty_end = end;
+    } else {
+        dirty_start = std::min(dirty_start, start);
+        dirty_end = std::max(dirty_end, end);
+    }
+    swap_pending = true;
+}
+
+// Everything drawn during one poll is flushed and shown at once
+void KeyboardTouchHandler::present() {
+    upload_layer(default_layer);
+    if (default_layer.in_vram) {
+        upload_layer(alt_layer);
+    }
 
-    gfxFlushBuffers();
+    if (!swap_pending || !finish_screen_copy()) {
+        return;
+    }
+    if (dirty_start >= 0) {
+        u8 *gfxbtmadr = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+        GSPGPU_FlushDataCache(gfxbtmadr + dirty_start,
+                              dirty_end - dirty_start);
+    }
     gfxScreenSwapBuffers(GFX_BOTTOM, false);
+    dirty_start = -1;
+    swap_pending = false;
 }
 
 void KeyboardTouchHandler::set_screen_key(KeyInfo &key_info) {
+    if (copied_layer) {
+        // Drawn with the others once the layer copy is done
+        return;
+    }
     u8 *gfxbtmadr = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
 
     const uint8_t *bgr_buffer;
@@ -63,16 +267,23 @@ void KeyboardTouchHandler::set_screen_key(KeyInfo &key_info) {
         break;
     }
 
+    // Key rects aren't aligned for the transfer engine, they are small enough
+    // to copy by hand and get flushed together in present
+    int bgr_size = (key_info.max_y - key_info.min_y) * key_px_size;
+    int first_offset = 0;
+    int bgr_offset = 0;
     for (int x = key_info.min_x; x < key_info.max_x; x++) {
-        int bgr_offset =
+        bgr_offset =
             ((GSP_SCREEN_WIDTH * x) + (GSP_SCREEN_WIDTH - key_info.max_y)) *
             key_px_size;
-        int bgr_size = (key_info.max_y - key_info.min_y) * key_px_size;
+        if (x == key_info.min_x) {
+            first_offset = bgr_offset;
+        }
         memcpy(gfxbtmadr + bgr_offset, bgr_buffer + bgr_offset, bgr_size);
     }
-
-    gfxFlushBuffers();
-    gfxScreenSwapBuffers(GFX_BOTTOM, false);
+    if (key_info.max_x > key_info.min_x) {
+        mark_dirty(first_offset, bgr_offset + bgr_size);
+    }
 }
 
 void KeyboardTouchHandler::set_shift_keys() {
@@ -83,16 +294,20 @@ void KeyboardTouchHandler::set_shift_keys() {
     set_screen_key(shift_keys);
 }
 
-void KeyboardTouchHandler::handle_default() {
-    set_screen(keyboard_bgr, keyboard_bgr_size);
-    selected_keycodes = &default_keycodes;
-    alt_keyboard_active = false;
+void KeyboardTouchHandler::draw_modifier_keys() {
     set_screen_key(shift_info);
     set_screen_key(ctrl_info);
     set_screen_key(alt_info);
     set_shift_keys();
 }
 
+void KeyboardTouchHandler::handle_default() {
+    selected_keycodes = &default_keycodes;
+    alt_keyboard_active = false;
+    set_screen(default_layer);
+    draw_modifier_keys();
+}
+
 void KeyboardTouchHandler::cycle_key_state(KeyInfo &key_info) {
     switch (key_info.state) {
     case (KEY_TEMPORARY):
@@ -112,13 +327,10 @@ void KeyboardTouchHandler::handle_alt_keyboard() {
     if (alt_keyboard_active) {
         handle_default();
     } else {
-        set_screen(keyboard_alt_bgr, keyboard_alt_bgr_size);
         selected_keycodes = &alt_keycodes;
         alt_keyboard_active = true;
-        set_screen_key(shift_info);
-        set_screen_key(ctrl_info);
-        set_screen_key(alt_info);
-        set_shift_keys();
+        set_screen(alt_layer);
+        draw_modifier_keys();
     }
 }
 
@@ -166,7 +378,8 @@ void KeyboardTouchHandler::_handle_touch_down(touchPosition touch) {
             cycle_key_state(alt_info);
         }
         int modifiers = get_key_mod();
-        LiSendKeyboardEvent(active_keycode.code, KEY_ACTION_DOWN, modifiers);
+        n3ds_input_batch.keyboard(active_keycode.code, KEY_ACTION_DOWN,
+                                  modifiers);
     }
 }
 
@@ -176,7 +389,7 @@ void KeyboardTouchHandler::_handle_touch_up(touchPosition touch) {
     }
 
     int modifiers = get_key_mod();
-    LiSendKeyboardEvent(active_keycode.code, KEY_ACTION_UP, modifiers);
+    n3ds_input_batch.keyboard(active_keycode.code, KEY_ACTION_UP, modifiers);
 
     if (active_keycode.code != SHIFT_KC && active_keycode.code != CTRL_KC &&
         active_keycode.code != ALT_KC) {
@@ -17,6 +17,7 @@
  * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "N3dsInputBatch.hpp"
 #include "N3dsTouchscreenInput.hpp"
 #include "touchpad_bgr.h"
 #include <Limelight.h>
@@ -44,16 +45,16 @@ void MouseTouchHandler::_handle_touch_down(touchPosition touch) {
         }
     } else if (touch.px > 160) {
         mouse_button = BUTTON_RIGHT;
-        LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_RIGHT);
+        n3ds_input_batch.mouse_button(BUTTON_ACTION_PRESS, BUTTON_RIGHT);
     } else {
         mouse_button = BUTTON_LEFT;
-        LiSendMouseButtonEvent(BUTTON_ACTION_PRESS, BUTTON_LEFT);
+        n3ds_input_batch.mouse_button(BUTTON_ACTION_PRESS, BUTTON_LEFT);
     }
 }
 
 void MouseTouchHandler::_handle_touch_up(touchPosition touch) {
     if (mouse_button > -1) {
-        LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE, mouse_button);
+        n3ds_input_batch.mouse_button(BUTTON_ACTION_RELEASE, mouse_button);
     }
     mouse_button = -1;
     previous_x = -1;
@@ -72,11 +73,11 @@ void MouseTouchHandler::_handle_touch_hold(touchPosition touch) {
     previous_y = touch.py;
 
     if (v_scroll) {
-        LiSendScrollEvent(-1 * deltaY);
+        n3ds_input_batch.scroll(-1 * deltaY);
     } else if (h_scroll) {
-        LiSendHScrollEvent(deltaX);
+        n3ds_input_batch.hscroll(deltaX);
     } else {
-        LiSendMouseMoveEvent(N3DS_MOUSEPAD_SENSITIVITY * deltaX,
-                             N3DS_MOUSEPAD_SENSITIVITY * deltaY);
+        n3ds_input_batch.mouse_move(N3DS_MOUSEPAD_SENSITIVITY * deltaX,
+                                    N3DS_MOUSEPAD_SENSITIVITY * deltaY);
     }
 }
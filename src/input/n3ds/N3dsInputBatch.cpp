@@ -0,0 +1,183 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "N3dsInputBatch.hpp"
+#include <Limelight.h>
+
+static const int active_gamepad_mask = 1;
+
+N3dsInputBatch n3ds_input_batch;
+
+// Moves and scrolls are merged into the event before them when it is of the
+// same kind, presses and key events are always kept
+N3dsInputBatch::Event *N3dsInputBatch::queue(EventType type) {
+    events++;
+    if (ordered_count > 0 && ordered[ordered_count - 1].type == type &&
+        type != EVENT_MOUSE_BUTTON && type != EVENT_KEYBOARD) {
+        return &ordered[ordered_count - 1];
+    }
+    if (ordered_count == N3DS_INPUT_BATCH_EVENTS) {
+        flush_ordered();
+    }
+    Event *event = &ordered[ordered_count++];
+    event->type = type;
+    event->a = event->b = event->c = event->d = 0;
+    return event;
+}
+
+void N3dsInputBatch::mouse_button(char action, int button) {
+    Event *event = queue(EVENT_MOUSE_BUTTON);
+    event->a = action;
+    event->b = button;
+}
+
+void N3dsInputBatch::mouse_move(short dx, short dy) {
+    Event *event = queue(EVENT_MOUSE_MOVE);
+    event->a += dx;
+    event->b += dy;
+}
+
+void N3dsInputBatch::mouse_position(short x, short y, short ref_width,
+                                    short ref_height) {
+    Event *event = queue(EVENT_MOUSE_POSITION);
+    event->a = x;
+    event->b = y;
+    event->c = ref_width;
+    event->d = ref_height;
+}
+
+void N3dsInputBatch::scroll(short amount) {
+    queue(EVENT_SCROLL)->a += amount;
+}
+
+void N3dsInputBatch::hscroll(short amount) {
+    queue(EVENT_HSCROLL)->a += amount;
+}
+
+void N3dsInputBatch::keyboard(short key_code, char key_action,
+                              char modifiers) {
+    Event *event = queue(EVENT_KEYBOARD);
+    event->a = key_code;
+    event->b = key_action;
+    event->c = modifiers;
+}
+
+void N3dsInputBatch::controller(int buttons, unsigned char left_trigger,
+                                unsigned char right_trigger, short left_x,
+                                short left_y, short right_x, short right_y) {
+    events++;
+    pad = {buttons, left_trigger, right_trigger,
+           left_x,  left_y,       right_x,       right_y};
+    pad_pending = true;
+}
+
+void N3dsInputBatch::motion(unsigned char motion_type, float x, float y,
+                            float z) {
+    Motion &state = motion_type == LI_MOTION_TYPE_GYRO ? gyro : accel;
+    events++;
+    state.x = x;
+    state.y = y;
+    state.z = z;
+    state.pending = true;
+}
+
+void N3dsInputBatch::set_motion_rate(unsigned char motion_type,
+                                     unsigned short rate_hz) {
+    Motion &state = motion_type == LI_MOTION_TYPE_GYRO ? gyro : accel;
+    state.rate_hz = rate_hz;
+}
+
+void N3dsInputBatch::flush_ordered() {
+    for (int i = 0; i < ordered_count; i++) {
+        const Event &event = ordered[i];
+        switch (event.type) {
+        case EVENT_MOUSE_BUTTON:
+            LiSendMouseButtonEvent(event.a, event.b);
+            break;
+        case EVENT_MOUSE_MOVE:
+            if (event.a == 0 && event.b == 0) {
+                continue;
+            }
+            LiSendMouseMoveEvent(event.a, event.b);
+            break;
+        case EVENT_MOUSE_POSITION:
+            LiSendMousePositionEvent(event.a, event.b, event.c, event.d);
+            break;
+        case EVENT_SCROLL:
+            if (event.a == 0) {
+                continue;
+            }
+            LiSendScrollEvent(event.a);
+            break;
+        case EVENT_HSCROLL:
+            if (event.a == 0) {
+                continue;
+            }
+            LiSendHScrollEvent(event.a);
+            break;
+        case EVENT_KEYBOARD:
+            LiSendKeyboardEvent(event.a, event.b, event.c);
+            break;
+        }
+        sends++;
+    }
+    ordered_count = 0;
+}
+
+void N3dsInputBatch::flush_motion(unsigned char motion_type, Motion &state,
+                                  u64 now) {
+    unsigned short rate_hz = state.rate_hz;
+    if (!state.pending || rate_hz == 0) {
+        return;
+    }
+    // The newest sample waits for the next tick if this one is too early
+    if (now - state.last_sent < SYSCLOCK_ARM11 / rate_hz) {
+        return;
+    }
+    LiSendControllerMotionEvent(0, motion_type, state.x, state.y, state.z);
+    sends++;
+    state.pending = false;
+    state.last_sent = now;
+}
+
+void N3dsInputBatch::flush() {
+    flush_ordered();
+    if (pad_pending) {
+        LiSendMultiControllerEvent(0, active_gamepad_mask, pad.buttons,
+                                   pad.left_trigger, pad.right_trigger,
+                                   pad.left_x, pad.left_y, pad.right_x,
+                                   pad.right_y);
+        sends++;
+        pad_pending = false;
+    }
+
+    // After the buttons, so motion never arrives ahead of them
+    u64 now = svcGetSystemTick();
+    flush_motion(LI_MOTION_TYPE_ACCEL, accel, now);
+    flush_motion(LI_MOTION_TYPE_GYRO, gyro, now);
+}
+
+void N3dsInputBatch::reset() {
+    ordered_count = 0;
+    pad_pending = false;
+    accel.pending = false;
+    accel.rate_hz = 0;
+    gyro.pending = false;
+    gyro.rate_hz = 0;
+    events = 0;
+    sends = 0;
+}
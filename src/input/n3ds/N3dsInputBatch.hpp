@@ -0,0 +1,94 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <3ds.h>
+#include <atomic>
+
+// Events gathered between flushes before they are sent early
+#define N3DS_INPUT_BATCH_EVENTS 16
+
+// Gathers everything produced during one input poll and sends it together.
+// Mouse, scroll and keyboard events go out first in the order they were
+// queued, then the latest controller state, then motion, which is held back
+// to the report rate the host asked for. Back to back moves and scrolls are
+// merged, as are repeated controller and motion updates.
+class N3dsInputBatch {
+  public:
+    void mouse_button(char action, int button);
+    void mouse_move(short dx, short dy);
+    void mouse_position(short x, short y, short ref_width, short ref_height);
+    void scroll(short amount);
+    void hscroll(short amount);
+    void keyboard(short key_code, char key_action, char modifiers);
+
+    void controller(int buttons, unsigned char left_trigger,
+                    unsigned char right_trigger, short left_x, short left_y,
+                    short right_x, short right_y);
+    void motion(unsigned char motion_type, float x, float y, float z);
+    // Zero stops motion of that type from being sent
+    void set_motion_rate(unsigned char motion_type, unsigned short rate_hz);
+
+    void flush();
+    // Forgets anything pending, for the end of a stream
+    void reset();
+
+  public:
+    // Events handed to the batch and calls actually made to send them
+    uint64_t events = 0;
+    uint64_t sends = 0;
+
+  private:
+    enum EventType {
+        EVENT_MOUSE_BUTTON,
+        EVENT_MOUSE_MOVE,
+        EVENT_MOUSE_POSITION,
+        EVENT_SCROLL,
+        EVENT_HSCROLL,
+        EVENT_KEYBOARD,
+    };
+    struct Event {
+        EventType type;
+        short a, b, c, d;
+    };
+    struct Controller {
+        int buttons;
+        unsigned char left_trigger, right_trigger;
+        short left_x, left_y, right_x, right_y;
+    };
+    struct Motion {
+        float x, y, z;
+        bool pending = false;
+        u64 last_sent = 0;
+        std::atomic<unsigned short> rate_hz{0};
+    };
+
+    Event *queue(EventType type);
+    void flush_ordered();
+    void flush_motion(unsigned char motion_type, Motion &state, u64 now);
+
+  private:
+    Event ordered[N3DS_INPUT_BATCH_EVENTS];
+    int ordered_count = 0;
+    Controller pad;
+    bool pad_pending = false;
+    Motion accel;
+    Motion gyro;
+};
+
+extern N3dsInputBatch n3ds_input_batch;
@@ -19,6 +19,8 @@
 
 #include "N3dsTouchscreenInput.hpp"
 
+#include <cstring>
+
 N3dsTouchscreenInput::N3dsTouchscreenInput(GAMEPAD_STATE *gamepad_in,
                                            N3dsTouchType touch_type_in)
     : gamepad_state(gamepad_in), touch_type(touch_type_in) {
@@ -74,6 +76,8 @@ N3dsTouchscreenInput::previous_touchpad_pressed(touchPosition touch) {
 }
 
 inline void N3dsTouchscreenInput::init_touch_handler() {
+    // The old handler may still have a copy to the screen queued
+    handler = nullptr;
     switch (touch_type) {
     case GAMEPAD:
         handler = std::make_unique<GamepadTouchHandler>(gamepad_state);
@@ -94,6 +98,23 @@ inline void N3dsTouchscreenInput::init_touch_handler() {
         handler = nullptr;
         break;
     }
+    if (handler) {
+        handler->present();
+    }
+}
+
+void N3dsTouchscreenInput::redraw() {
+    handler = nullptr;
+    // Not every touch mode has an image of its own
+    GSPGPU_FramebufferFormat px_fmt_btm = gfxGetScreenFormat(GFX_BOTTOM);
+    int px_size_btm = gspGetBytesPerPixel(px_fmt_btm);
+    u8 *gfxbtmadr = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+    memset(gfxbtmadr, 0,
+           GSP_SCREEN_HEIGHT_BOTTOM * GSP_SCREEN_WIDTH * px_size_btm);
+    gfxFlushBuffers();
+    gfxScreenSwapBuffers(GFX_BOTTOM, false);
+
+    init_touch_handler();
 }
 
 void N3dsTouchscreenInput::n3dsinput_handle_touch(u32 kDown, u32 kUp) {
@@ -113,4 +134,8 @@ void N3dsTouchscreenInput::n3dsinput_handle_touch(u32 kDown, u32 kUp) {
     } else {
         handler->handle_touch_hold(touch);
     }
+    // Handlers may have been swapped out above
+    if (handler) {
+        handler->present();
+    }
 }
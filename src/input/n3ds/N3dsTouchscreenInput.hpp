@@ -40,9 +40,12 @@ typedef struct _GAMEPAD_STATE {
 
 class TouchHandlerBase {
   public:
+    virtual ~TouchHandlerBase() = default;
     void handle_touch_down(touchPosition touch);
     void handle_touch_up(touchPosition touch);
     void handle_touch_hold(touchPosition touch);
+    // Shows whatever was drawn while handling this poll's touches
+    virtual void present() {}
 
   private:
     virtual void _handle_touch_down(touchPosition touch) = 0;
@@ -92,9 +95,26 @@ struct KeyInfo {
     int max_y;
 };
 
+class KeyboardLayerCopy;
+
+// A full screen keyboard image the GPU can copy from, uploaded to VRAM in the
+// background once a renderer runs
+struct KeyboardLayer {
+    const uint8_t *bgr_buffer = nullptr;
+    int bgr_size = 0;
+    KeyboardLayerCopy *upload = nullptr;
+    void *data = nullptr;
+    void *staging = nullptr;
+    bool upload_queued = false;
+    bool in_vram = false;
+    bool no_vram = false;
+};
+
 class KeyboardTouchHandler : public TouchHandlerBase {
   public:
     KeyboardTouchHandler();
+    ~KeyboardTouchHandler();
+    void present();
 
   private:
     void _handle_touch_down(touchPosition touch);
@@ -102,9 +122,14 @@ class KeyboardTouchHandler : public TouchHandlerBase {
     void _handle_touch_hold(touchPosition touch);
 
     keycode_info get_keycode(touchPosition touch);
-    void set_screen(const uint8_t *bgr_buffer, int bgr_size);
+    void upload_layer(KeyboardLayer &layer);
+    void free_layer(KeyboardLayer &layer);
+    void set_screen(KeyboardLayer &layer);
+    bool finish_screen_copy();
     void set_screen_key(KeyInfo &key_info);
+    void mark_dirty(int start, int end);
     void set_shift_keys();
+    void draw_modifier_keys();
     void handle_default();
     void cycle_key_state(KeyInfo &key_info);
     void handle_alt_keyboard();
@@ -112,6 +137,15 @@ class KeyboardTouchHandler : public TouchHandlerBase {
 
   private:
     int key_px_size;
+    KeyboardLayer default_layer;
+    KeyboardLayer alt_layer;
+    // Layer on screen, which the GPU may still be copying
+    const KeyboardLayer *shown_layer = nullptr;
+    const KeyboardLayer *copied_layer = nullptr;
+    // Framebuffer bytes the CPU wrote since the last present
+    int dirty_start = -1;
+    int dirty_end = 0;
+    bool swap_pending = false;
     keycode_info active_keycode{-1, false};
     KeyInfo shift_info = {KEY_DISABLED, 0, 48, 136, 169};
     KeyInfo ctrl_info = {KEY_DISABLED, 64, 127, 0, 37};
@@ -145,6 +179,8 @@ class N3dsTouchscreenInput {
     ~N3dsTouchscreenInput() = default;
 
     void n3dsinput_handle_touch(u32 kDown, u32 kUp);
+    // Restores the bottom screen after something else has drawn over it
+    void redraw();
 
   private:
     inline void init_touch_handler();
@@ -0,0 +1,86 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StickTransform.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+// Entries in the gain table, spread evenly over the squared radius
+#define STICK_GAIN_ENTRIES 4096
+// Readings past the range still come in towards the corners of the gate
+#define STICK_OVERSHOOT 2
+
+StickTransform::StickTransform(const StickProfile &profile)
+    : gain(STICK_GAIN_ENTRIES) {
+    int range = std::max(profile.range, 1);
+    axial = range * profile.axial_deadzone / 100;
+    max_radius_sq = (int64_t)range * range * STICK_OVERSHOOT;
+
+    double deadzone = range * std::max(profile.deadzone, 0) / 100.0;
+    deadzone = std::min(deadzone, range - 1.0);
+    double anti = std::min(std::max(profile.anti_deadzone, 0), 99) / 100.0;
+    double exponent = std::max(profile.curve, 10) / 100.0;
+
+    for (int i = 0; i < STICK_GAIN_ENTRIES; i++) {
+        // Middle of the slice of squared radii this entry covers
+        double radius =
+            std::sqrt((i + 0.5) * max_radius_sq / STICK_GAIN_ENTRIES);
+        if (radius < deadzone) {
+            gain[i] = 0;
+            continue;
+        }
+        // Slices reaching full deflection are scaled for their lowest
+        // radius, so the edge of the range always maps to full output
+        double radius_hi =
+            std::sqrt((double)(i + 1) * max_radius_sq / STICK_GAIN_ENTRIES);
+        if (radius_hi >= range) {
+            double radius_lo =
+                std::sqrt((double)i * max_radius_sq / STICK_GAIN_ENTRIES);
+            gain[i] = (uint32_t)std::ceil(SHRT_MAX / std::max(radius_lo, 1.0) *
+                                          65536.0);
+            continue;
+        }
+        double travel = (radius - deadzone) / (range - deadzone);
+        double magnitude = anti + (1.0 - anti) * std::pow(travel, exponent);
+        gain[i] = (uint32_t)(magnitude * SHRT_MAX / radius * 65536.0);
+    }
+}
+
+// Rounds towards zero so both directions of an axis respond the same
+static inline short scale_axis(int raw, int64_t gain) {
+    int64_t scaled = std::abs(raw) * gain >> 16;
+    scaled = std::min<int64_t>(SHRT_MAX, scaled);
+    return (short)(raw < 0 ? -scaled : scaled);
+}
+
+void StickTransform::apply(int raw_x, int raw_y, short *out_x,
+                           short *out_y) const {
+    if (std::abs(raw_x) < axial) {
+        raw_x = 0;
+    }
+    if (std::abs(raw_y) < axial) {
+        raw_y = 0;
+    }
+    int64_t radius_sq = (int64_t)raw_x * raw_x + (int64_t)raw_y * raw_y;
+    int64_t idx = std::min<int64_t>(
+        radius_sq * STICK_GAIN_ENTRIES / max_radius_sq, STICK_GAIN_ENTRIES - 1);
+    int64_t g = gain[idx];
+    *out_x = scale_axis(raw_x, g);
+    *out_y = scale_axis(raw_y, g);
+}
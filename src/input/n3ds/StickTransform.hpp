@@ -0,0 +1,56 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the response curves can be checked on the host.
+
+#include <cstdint>
+#include <vector>
+
+// Shape of one analog stick's response. Percentages are of the stick range.
+struct StickProfile {
+    // Raw reading at full deflection, found by calibration
+    int range;
+    // Radius below which the stick reads as centered
+    int deadzone;
+    // Each axis reads as zero while it is within this of the center, so a
+    // push straight up doesn't drift sideways
+    int axial_deadzone;
+    // Output the first movement past the deadzone jumps to, for games that
+    // have their own deadzone
+    int anti_deadzone;
+    // Response exponent in hundredths, 100 is linear and larger is finer
+    // near the center
+    int curve;
+};
+
+// Maps raw stick readings to the -32767..32767 range sent to the host. The
+// shaping is precomputed into a gain table over the squared radius, so each
+// poll costs one lookup and a multiply per axis.
+class StickTransform {
+  public:
+    explicit StickTransform(const StickProfile &profile);
+
+    void apply(int raw_x, int raw_y, short *out_x, short *out_y) const;
+
+  private:
+    int axial;
+    int64_t max_radius_sq;
+    // Output magnitude over input radius, in 16.16 fixed point
+    std::vector<uint32_t> gain;
+};
@@ -18,10 +18,13 @@
  */
 
 #include "n3ds_input.hpp"
+#include "n3ds/GyroAim.hpp"
+#include "n3ds/N3dsInputBatch.hpp"
+#include "n3ds/StickTransform.hpp"
+#include "../n3ds/n3ds_perf_hud.hpp"
 
 #include <3ds.h>
 #include <Limelight.h>
-#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
@@ -36,15 +39,23 @@
 #define N3DS_ANALOG_MAX 150
 #define N3DS_C_STICK_MAX 100
 #define N3DS_ANALOG_POS_FACTOR 5
+// Raw accelerometer reading of 1 g, unless calibrated
+#define N3DS_ACCEL_RANGE 510
+#define STANDARD_GRAVITY 9.80665f
 
 static GAMEPAD_STATE gamepad_state, previous_state;
 std::unique_ptr<N3dsTouchscreenInput> touch_handler = nullptr;
 
 static const int activeGamepadMask = 1;
 static float gyro_coeff = 0;
-// Note: This was found experimentally and may need a calibration option in
-// settings
-static float accel_coeff = 52.0;
+// Raw accelerometer units per m/s^2
+static float accel_coeff = N3DS_ACCEL_RANGE / STANDARD_GRAVITY;
+static std::unique_ptr<StickTransform> circle_pad_transform = nullptr;
+static std::unique_ptr<StickTransform> c_stick_transform = nullptr;
+static std::unique_ptr<GyroAim> gyro_aim = nullptr;
+static u64 gyro_aim_ticks = 0;
+// Held to turn the system without moving the cursor in gyro aim mode
+static u32 gyro_ratchet_button = 0;
 bool enable_gyro = false;
 bool enable_accel = false;
 bool use_triggers_for_mouse = false;
@@ -104,15 +115,54 @@ void n3dsinput_init(N3dsTouchType touch_type, bool swap_face_buttons,
 
     touch_handler =
         std::make_unique<N3dsTouchscreenInput>(&gamepad_state, touch_type);
+
+    // Plain linear response until tuning is applied
+    n3dsinput_set_tuning({N3DS_ANALOG_MAX, 0, 0, 0, 100},
+                         {N3DS_C_STICK_MAX, 0, 0, 0, 100}, N3DS_ACCEL_RANGE);
+}
+
+void n3dsinput_set_tuning(const StickProfile &circle_pad,
+                          const StickProfile &c_stick, int accel_range) {
+    circle_pad_transform = std::make_unique<StickTransform>(circle_pad);
+    c_stick_transform = std::make_unique<StickTransform>(c_stick);
+    if (accel_range > 0) {
+        accel_coeff = accel_range / STANDARD_GRAVITY;
+    }
 }
 
+void n3dsinput_set_gyro_aim(const GyroAimSettings *settings,
+                            u32 ratchet_button) {
+    gyro_ratchet_button = settings ? ratchet_button : 0;
+    if (settings) {
+        gyro_aim = std::make_unique<GyroAim>(*settings);
+        gyro_aim_ticks = 0;
+        HIDUSER_EnableGyroscope();
+    } else if (gyro_aim) {
+        gyro_aim = nullptr;
+        HIDUSER_DisableGyroscope();
+    }
+}
+
+bool n3dsinput_gyro_aim_active() { return gyro_aim != nullptr; }
+
 void n3dsinput_cleanup() {
+    n3dsinput_set_gyro_aim(nullptr);
+    printf("Input: %llu events sent in %llu packets\n", n3ds_input_batch.events,
+           n3ds_input_batch.sends);
+    n3ds_input_batch.reset();
     remove_gamepad();
     gamepad_state = GAMEPAD_STATE();
     previous_state = GAMEPAD_STATE();
     touch_handler = nullptr;
 }
 
+void n3dsinput_redraw_touch() { touch_handler->redraw(); }
+
+void n3dsinput_set_motion_rate(unsigned char motion_type,
+                               unsigned short rate_hz) {
+    n3ds_input_batch.set_motion_rate(motion_type, rate_hz);
+}
+
 static inline int n3ds_to_li_button(u32 key_in, u32 key_n3ds, int key_li) {
     return ((key_in & key_n3ds) / key_n3ds) * key_li;
 }
@@ -138,15 +188,6 @@ static inline unsigned char n3ds_to_li_trigger(u32 key_in, u32 key_n3ds) {
     return ((key_in & key_n3ds) / key_n3ds) * 255UL;
 }
 
-static inline int scale_n3ds_axis(int axis_n3ds, int axis_max) {
-    if (axis_n3ds > axis_max) {
-        return SHRT_MAX;
-    } else if (axis_n3ds < -axis_max) {
-        return -SHRT_MAX;
-    }
-    return (axis_n3ds * SHRT_MAX) / axis_max;
-}
-
 static inline bool joystick_state_changed(short before, short after) {
     return (before / N3DS_ANALOG_POS_FACTOR) !=
            (after / N3DS_ANALOG_POS_FACTOR);
@@ -199,8 +240,16 @@ int n3dsinput_handle_event() {
     u32 kDown = hidKeysDown();
     u32 kUp = hidKeysUp();
     previous_state = gamepad_state;
+    if (gyro_aim) {
+        // The ratchet button is not passed on to the host
+        kDown &= ~gyro_ratchet_button;
+        kUp &= ~gyro_ratchet_button;
+    }
 
-    touch_handler->n3dsinput_handle_touch(kDown, kUp);
+    // The HUD covers the touch controls while it is shown
+    if (!n3ds_perf_hud_visible()) {
+        touch_handler->n3dsinput_handle_touch(kDown, kUp);
+    }
 
     if (kDown) {
         gamepad_state.buttons |= n3ds_to_li_buttons(kDown);
@@ -218,40 +267,40 @@ int n3dsinput_handle_event() {
 
     circlePosition cpad_pos;
     hidCircleRead(&cpad_pos);
-    gamepad_state.leftStickX = scale_n3ds_axis(cpad_pos.dx, N3DS_ANALOG_MAX);
-    gamepad_state.leftStickY = scale_n3ds_axis(cpad_pos.dy, N3DS_ANALOG_MAX);
+    circle_pad_transform->apply(cpad_pos.dx, cpad_pos.dy,
+                                &gamepad_state.leftStickX,
+                                &gamepad_state.leftStickY);
 
     circlePosition cstick_pos;
     hidCstickRead(&cstick_pos);
-    gamepad_state.rightStickX =
-        scale_n3ds_axis(cstick_pos.dx, N3DS_C_STICK_MAX);
-    gamepad_state.rightStickY =
-        scale_n3ds_axis(cstick_pos.dy, N3DS_C_STICK_MAX);
+    c_stick_transform->apply(cstick_pos.dx, cstick_pos.dy,
+                             &gamepad_state.rightStickX,
+                             &gamepad_state.rightStickY);
 
     if (gamepad_state_changed()) {
         if (use_triggers_for_mouse) {
             if (previous_state.leftTrigger != gamepad_state.leftTrigger) {
-                LiSendMouseButtonEvent(gamepad_state.leftTrigger
-                                           ? BUTTON_ACTION_PRESS
-                                           : BUTTON_ACTION_RELEASE,
-                                       BUTTON_LEFT);
+                n3ds_input_batch.mouse_button(gamepad_state.leftTrigger
+                                                  ? BUTTON_ACTION_PRESS
+                                                  : BUTTON_ACTION_RELEASE,
+                                              BUTTON_LEFT);
             }
             if (previous_state.rightTrigger != gamepad_state.rightTrigger) {
-                LiSendMouseButtonEvent(gamepad_state.rightTrigger
-                                           ? BUTTON_ACTION_PRESS
-                                           : BUTTON_ACTION_RELEASE,
-                                       BUTTON_RIGHT);
+                n3ds_input_batch.mouse_button(gamepad_state.rightTrigger
+                                                  ? BUTTON_ACTION_PRESS
+                                                  : BUTTON_ACTION_RELEASE,
+                                              BUTTON_RIGHT);
             }
-            LiSendMultiControllerEvent(
-                0, activeGamepadMask, gamepad_state.buttons, 0, 0,
-                gamepad_state.leftStickX, gamepad_state.leftStickY,
-                gamepad_state.rightStickX, gamepad_state.rightStickY);
+            n3ds_input_batch.controller(
+                gamepad_state.buttons, 0, 0, gamepad_state.leftStickX,
+                gamepad_state.leftStickY, gamepad_state.rightStickX,
+                gamepad_state.rightStickY);
         } else {
-            LiSendMultiControllerEvent(
-                0, activeGamepadMask, gamepad_state.buttons,
-                gamepad_state.leftTrigger, gamepad_state.rightTrigger,
-                gamepad_state.leftStickX, gamepad_state.leftStickY,
-                gamepad_state.rightStickX, gamepad_state.rightStickY);
+            n3ds_input_batch.controller(
+                gamepad_state.buttons, gamepad_state.leftTrigger,
+                gamepad_state.rightTrigger, gamepad_state.leftStickX,
+                gamepad_state.leftStickY, gamepad_state.rightStickX,
+                gamepad_state.rightStickY);
         }
     }
 
@@ -262,8 +311,8 @@ int n3dsinput_handle_event() {
         gamepad_state.accel_vector_y = trunc(accel_vector.y / accel_coeff);
         gamepad_state.accel_vector_z = trunc(accel_vector.z / accel_coeff);
         if (accelerometer_state_changed()) {
-            LiSendControllerMotionEvent(
-                0, LI_MOTION_TYPE_ACCEL, gamepad_state.accel_vector_x,
+            n3ds_input_batch.motion(
+                LI_MOTION_TYPE_ACCEL, gamepad_state.accel_vector_x,
                 gamepad_state.accel_vector_y, gamepad_state.accel_vector_z);
         }
     }
@@ -275,11 +324,30 @@ int n3dsinput_handle_event() {
         gamepad_state.gyro_rate_y = trunc(gyro_rate.y / gyro_coeff);
         gamepad_state.gyro_rate_z = trunc(-1 * gyro_rate.z / gyro_coeff);
         if (gyroscope_state_changed()) {
-            LiSendControllerMotionEvent(
-                0, LI_MOTION_TYPE_GYRO, gamepad_state.gyro_rate_x,
+            n3ds_input_batch.motion(
+                LI_MOTION_TYPE_GYRO, gamepad_state.gyro_rate_x,
                 gamepad_state.gyro_rate_y, gamepad_state.gyro_rate_z);
         }
     }
 
+    if (gyro_aim) {
+        u64 now = svcGetSystemTick();
+        float dt = gyro_aim_ticks
+                       ? (now - gyro_aim_ticks) / (float)SYSCLOCK_ARM11
+                       : 0;
+        gyro_aim_ticks = now;
+
+        angularRate gyro_rate;
+        hidGyroRead(&gyro_rate);
+        int dx, dy;
+        gyro_aim->update(gyro_rate.y / gyro_coeff, -gyro_rate.x / gyro_coeff,
+                         dt, hidKeysHeld() & gyro_ratchet_button, &dx, &dy);
+        if (dx || dy) {
+            n3ds_input_batch.mouse_move(dx, dy);
+        }
+    }
+
+    // Everything from this poll goes out together
+    n3ds_input_batch.flush();
     return 0;
 }
@@ -19,7 +19,9 @@
 
 #pragma once
 
+#include "n3ds/GyroAim.hpp"
 #include "n3ds/N3dsTouchscreenInput.hpp"
+#include "n3ds/StickTransform.hpp"
 #include <stdbool.h>
 
 extern bool enable_gyro;
@@ -28,6 +30,20 @@ extern bool enable_accel;
 void n3dsinput_init(N3dsTouchType touch_type, bool swap_face_buttons,
                     bool swap_triggers_and_shoulders,
                     bool use_triggers_for_mouse_in);
+// Stick response and the raw accelerometer reading of 1 g, applied to the
+// next poll
+void n3dsinput_set_tuning(const StickProfile &circle_pad,
+                          const StickProfile &c_stick, int accel_range);
+// Turns the system's rotation into mouse movement, NULL turns it off. The
+// ratchet button (0 for none) is held to turn without moving the cursor and
+// is not passed on to the host.
+void n3dsinput_set_gyro_aim(const GyroAimSettings *settings,
+                            u32 ratchet_button = 0);
+bool n3dsinput_gyro_aim_active();
 void n3dsinput_cleanup();
 void n3dsinput_set_touch(enum N3dsTouchType ttype);
+void n3dsinput_redraw_touch();
+// Motion is sent no faster than the host asked for, zero disables it
+void n3dsinput_set_motion_rate(unsigned char motion_type,
+                               unsigned short rate_hz);
 int n3dsinput_handle_event();
@@ -0,0 +1,154 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_cache.hpp"
+#include "pair_record.hpp"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define HOST_CACHE_DIR MOONLIGHT_3DS_PATH "/cache"
+#define HOST_CACHE_MAGIC 0x3143484d // "MHC1"
+#define HOST_CACHE_VERSION 2
+
+// The file is the header followed by the apps, all fixed size so it can be
+// read with a single call
+struct HostCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    char app_version[32];
+    uint16_t app_count;
+    uint16_t reserved;
+};
+
+struct HostCacheApp {
+    int32_t id;
+    char name[60];
+};
+
+static std::string host_cache_path(const std::string &unique_id) {
+    // The id comes from the network, keep it from leaving the directory
+    std::string name;
+    for (char c : unique_id) {
+        if (isalnum((unsigned char)c) || c == '-') {
+            name += c;
+        }
+    }
+    if (name.empty()) {
+        return "";
+    }
+    return HOST_CACHE_DIR "/" + name + ".bin";
+}
+
+static std::string read_field(const char *field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
+
+static void write_field(char *field, size_t size, const std::string &value) {
+    strncpy(field, value.c_str(), size - 1);
+    field[size - 1] = 0;
+}
+
+bool load_host_cache(const std::string &unique_id, HostCache *cache) {
+    std::string path = host_cache_path(unique_id);
+    FILE *fd = path.empty() ? NULL : fopen(path.c_str(), "rb");
+    if (fd == NULL) {
+        return false;
+    }
+
+    struct stat st;
+    std::vector<uint8_t> buffer;
+    if (fstat(fileno(fd), &st) == 0 &&
+        st.st_size >= (off_t)sizeof(HostCacheHeader)) {
+        buffer.resize(st.st_size);
+        if (fread(buffer.data(), 1, buffer.size(), fd) != buffer.size()) {
+            buffer.clear();
+        }
+    }
+    fclose(fd);
+    if (buffer.empty()) {
+        return false;
+    }
+
+    HostCacheHeader header;
+    memcpy(&header, buffer.data(), sizeof(header));
+    size_t expected =
+        sizeof(header) + header.app_count * sizeof(HostCacheApp);
+    if (header.magic != HOST_CACHE_MAGIC ||
+        header.version != HOST_CACHE_VERSION || buffer.size() != expected) {
+        return false;
+    }
+
+    cache->app_version =
+        read_field(header.app_version, sizeof(header.app_version));
+
+    const uint8_t *entry = buffer.data() + sizeof(header);
+    cache->apps.clear();
+    for (int i = 0; i < header.app_count; i++) {
+        HostCacheApp app;
+        memcpy(&app, entry, sizeof(app));
+        entry += sizeof(app);
+        cache->apps.push_back({app.id, read_field(app.name, sizeof(app.name))});
+    }
+    return true;
+}
+
+void save_host_cache(const std::string &unique_id, const HostCache &cache) {
+    std::string path = host_cache_path(unique_id);
+    if (path.empty()) {
+        return;
+    }
+
+    HostCacheHeader header = {};
+    header.magic = HOST_CACHE_MAGIC;
+    header.version = HOST_CACHE_VERSION;
+    write_field(header.app_version, sizeof(header.app_version),
+                cache.app_version);
+    header.app_count = cache.apps.size();
+
+    std::vector<uint8_t> buffer(sizeof(header));
+    memcpy(buffer.data(), &header, sizeof(header));
+    for (const CachedApp &cached_app : cache.apps) {
+        HostCacheApp app = {};
+        app.id = cached_app.id;
+        write_field(app.name, sizeof(app.name), cached_app.name);
+        const uint8_t *bytes = (const uint8_t *)&app;
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(app));
+    }
+
+    mkdir(HOST_CACHE_DIR, 0775);
+    FILE *fd = fopen(path.c_str(), "wb");
+    if (fd == NULL) {
+        return;
+    }
+    if (fwrite(buffer.data(), 1, buffer.size(), fd) != buffer.size()) {
+        fclose(fd);
+        remove(path.c_str());
+        return;
+    }
+    fclose(fd);
+}
+
+void remove_host_cache(const std::string &unique_id) {
+    std::string path = host_cache_path(unique_id);
+    if (!path.empty()) {
+        remove(path.c_str());
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct CachedApp {
+    int id;
+    std::string name;
+};
+
+// The app list a host reported the last time it was asked, so the app menu
+// can be shown before the host answers again. serverinfo is fetched on every
+// connect anyway, only the version it came with is kept to check the list.
+struct HostCache {
+    std::string app_version;
+    std::vector<CachedApp> apps;
+};
+
+// Entries are keyed by the uniqueid the host reports in serverinfo
+bool load_host_cache(const std::string &unique_id, HostCache *cache);
+void save_host_cache(const std::string &unique_id, const HostCache &cache);
+void remove_host_cache(const std::string &unique_id);
@@ -83,6 +83,7 @@ static void set_motion_event_state(unsigned short controllerNumber, unsigned cha
     return;
   }
 
+  n3dsinput_set_motion_rate(motionType, reportRateHz);
   switch (motionType) {
   case LI_MOTION_TYPE_ACCEL:
     enable_accel = (reportRateHz > 0);
@@ -98,7 +99,7 @@ static void set_motion_event_state(unsigned short controllerNumber, unsigned cha
     if (enable_gyro) {
       HIDUSER_EnableGyroscope();
     }
-    else {
+    else if (!n3dsinput_gyro_aim_active()) {
       HIDUSER_DisableGyroscope();
     }
     break;
@@ -0,0 +1,283 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "n3ds_perf_hud.hpp"
+#include "perf_stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#define HUD_WIDTH GSP_SCREEN_HEIGHT_BOTTOM
+#define HUD_HEIGHT GSP_SCREEN_WIDTH
+// 3x5 glyphs drawn at twice their size
+#define HUD_GLYPH_SCALE 2
+#define HUD_CHAR_ADVANCE (4 * HUD_GLYPH_SCALE)
+#define HUD_LINE_HEIGHT (6 * HUD_GLYPH_SCALE)
+#define HUD_CHART_HEIGHT 16
+#define HUD_PANEL_HEIGHT (HUD_LINE_HEIGHT + HUD_CHART_HEIGHT + 2)
+#define HUD_BAR_ADVANCE (HUD_WIDTH / PERF_STATS_SAMPLES)
+// One refresh of the panel, until the renderer has measured it
+#define HUD_FRAME_BUDGET_US 16713
+
+#define HUD_RGB565(r, g, b) (((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3))
+#define HUD_BLACK HUD_RGB565(0, 0, 0)
+#define HUD_WHITE HUD_RGB565(255, 255, 255)
+#define HUD_GREY HUD_RGB565(48, 48, 48)
+#define HUD_GREEN HUD_RGB565(0, 200, 0)
+#define HUD_YELLOW HUD_RGB565(255, 200, 0)
+#define HUD_RED HUD_RGB565(230, 0, 0)
+#define HUD_BLUE HUD_RGB565(40, 120, 255)
+
+enum hud_unit { HUD_UNIT_US, HUD_UNIT_MS, HUD_UNIT_BYTES };
+
+struct hud_panel {
+    const char *label;
+    perf_stat stat;
+    hud_unit unit;
+};
+
+static const hud_panel panels[] = {
+    {"NET", PERF_STAT_NETWORK, HUD_UNIT_US},
+    {"DEC", PERF_STAT_DECODE, HUD_UNIT_US},
+    {"CONV", PERF_STAT_CONVERT, HUD_UNIT_US},
+    {"GPU", PERF_STAT_PRESENT, HUD_UNIT_US},
+    {"VBL", PERF_STAT_VBLANK_OFFSET, HUD_UNIT_US},
+    {"AUD", PERF_STAT_AUDIO_QUEUE, HUD_UNIT_MS},
+    {"RATE", PERF_STAT_FRAME_BYTES, HUD_UNIT_BYTES},
+};
+
+// Rows top to bottom, 3 bits each with the leftmost pixel highest
+struct hud_glyph {
+    char c;
+    u16 rows;
+};
+
+static const hud_glyph glyphs[] = {
+    {'%', 0x52A5},
+    {'+', 0x05D0},
+    {'-', 0x01C0},
+    {'.', 0x0002},
+    {'/', 0x12A4},
+    {'0', 0x7B6F},
+    {'1', 0x2C97},
+    {'2', 0x73E7},
+    {'3', 0x73CF},
+    {'4', 0x5BC9},
+    {'5', 0x79CF},
+    {'6', 0x79EF},
+    {'7', 0x7249},
+    {'8', 0x7BEF},
+    {'9', 0x7BCF},
+    {':', 0x0410},
+    {'A', 0x2BED},
+    {'B', 0x6BAE},
+    {'C', 0x3923},
+    {'D', 0x6B6E},
+    {'E', 0x79A7},
+    {'F', 0x79A4},
+    {'G', 0x396B},
+    {'H', 0x5BED},
+    {'I', 0x7497},
+    {'J', 0x126A},
+    {'K', 0x5BAD},
+    {'L', 0x4927},
+    {'M', 0x5FED},
+    {'N', 0x6B6D},
+    {'O', 0x2B6A},
+    {'P', 0x6BA4},
+    {'Q', 0x2B73},
+    {'R', 0x6BAD},
+    {'S', 0x388E},
+    {'T', 0x7492},
+    {'U', 0x5B6F},
+    {'V', 0x5B6A},
+    {'W', 0x5BFD},
+    {'X', 0x5AAD},
+    {'Y', 0x5A92},
+    {'Z', 0x72A7},
+};
+
+static bool hud_visible = false;
+static u32 last_draw_ms = 0;
+
+static inline void put_px(u16 *fb, int x, int y, u16 color) {
+    // The framebuffer is stored rotated, one column of the screen per line
+    fb[x * HUD_HEIGHT + (HUD_HEIGHT - 1 - y)] = color;
+}
+
+static void fill_rect(u16 *fb, int x, int y, int w, int h, u16 color) {
+    for (int px = x; px < x + w && px < HUD_WIDTH; px++) {
+        for (int py = y; py < y + h && py < HUD_HEIGHT; py++) {
+            put_px(fb, px, py, color);
+        }
+    }
+}
+
+static void draw_text(u16 *fb, int x, int y, const char *text, u16 color) {
+    for (; *text; text++, x += HUD_CHAR_ADVANCE) {
+        const hud_glyph *glyph = std::find_if(
+            std::begin(glyphs), std::end(glyphs),
+            [&](const hud_glyph &g) { return g.c == *text; });
+        if (glyph == std::end(glyphs)) {
+            continue;
+        }
+        for (int row = 0; row < 5; row++) {
+            for (int col = 0; col < 3; col++) {
+                if (glyph->rows & (1 << ((4 - row) * 3 + (2 - col)))) {
+                    fill_rect(fb, x + col * HUD_GLYPH_SCALE,
+                              y + row * HUD_GLYPH_SCALE, HUD_GLYPH_SCALE,
+                              HUD_GLYPH_SCALE, color);
+                }
+            }
+        }
+    }
+}
+
+// Bits per second over the last second of frames, and the frame rate
+static void bitrate(const perf_stats_series &series, u32 now_ms, u32 *bps,
+                    u32 *fps) {
+    u64 bytes = 0;
+    *fps = 0;
+    for (int i = 0; i < series.count; i++) {
+        if (now_ms - series.times_ms[i] < 1000) {
+            bytes += series.values[i];
+            (*fps)++;
+        }
+    }
+    *bps = bytes * 8;
+}
+
+static void draw_panel(u16 *fb, int y, const hud_panel &panel, u32 now_ms,
+                       u32 budget_us) {
+    perf_stats_series series;
+    perf_stats_read(panel.stat, &series);
+
+    u32 max = 0;
+    u64 sum = 0;
+    for (int i = 0; i < series.count; i++) {
+        max = std::max(max, series.values[i]);
+        sum += series.values[i];
+    }
+    u32 last = series.count ? series.values[series.count - 1] : 0;
+    u32 avg = series.count ? sum / series.count : 0;
+
+    char line[48];
+    switch (panel.unit) {
+    case HUD_UNIT_US:
+        snprintf(line, sizeof(line), "%-4s NOW%5.1f AVG%5.1f MAX%5.1f MS",
+                 panel.label, last / 1000.0, avg / 1000.0, max / 1000.0);
+        break;
+    case HUD_UNIT_MS:
+        snprintf(line, sizeof(line), "%-4s NOW%5lu AVG%5lu MAX%5lu MS",
+                 panel.label, last, avg, max);
+        break;
+    case HUD_UNIT_BYTES: {
+        u32 bps, fps;
+        bitrate(series, now_ms, &bps, &fps);
+        snprintf(line, sizeof(line), "%-4s %5.1f MBPS %3lu FPS MAX%4luKB",
+                 panel.label, bps / 1000000.0, fps, max / 1024);
+        break;
+    }
+    }
+    draw_text(fb, 2, y, line, HUD_WHITE);
+
+    // Timings are scaled so the frame budget line sits halfway up the chart
+    int chart_y = y + HUD_LINE_HEIGHT;
+    u32 scale = max;
+    if (panel.unit == HUD_UNIT_US) {
+        scale = std::max<u32>(max, budget_us * 2);
+    }
+    fill_rect(fb, 0, chart_y, HUD_WIDTH, HUD_CHART_HEIGHT, HUD_GREY);
+    if (panel.unit == HUD_UNIT_US) {
+        int budget_h = (u64)budget_us * HUD_CHART_HEIGHT / scale;
+        fill_rect(fb, 0, chart_y + HUD_CHART_HEIGHT - budget_h, HUD_WIDTH, 1,
+                  HUD_GREEN);
+    }
+    if (scale == 0) {
+        return;
+    }
+
+    // Newest sample on the right
+    int x = HUD_WIDTH - series.count * HUD_BAR_ADVANCE;
+    for (int i = 0; i < series.count; i++, x += HUD_BAR_ADVANCE) {
+        u32 value = series.values[i];
+        int h = std::max(1, (int)((u64)value * HUD_CHART_HEIGHT / scale));
+        u16 color = HUD_BLUE;
+        if (panel.unit == HUD_UNIT_US) {
+            color = value > budget_us ? HUD_RED : HUD_YELLOW;
+        }
+        fill_rect(fb, x, chart_y + HUD_CHART_HEIGHT - h, HUD_BAR_ADVANCE - 1, h,
+                  color);
+    }
+}
+
+static void draw_hud() {
+    u16 *fb = (u16 *)gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+    memset(fb, 0, HUD_WIDTH * HUD_HEIGHT * sizeof(u16));
+
+    u32 now_ms = perf_stats_now_ms();
+    u32 budget_us = perf_stats_counter(PERF_COUNTER_FRAME_PERIOD);
+    if (budget_us == 0) {
+        budget_us = HUD_FRAME_BUDGET_US;
+    }
+    int y = 2;
+    for (const hud_panel &panel : panels) {
+        draw_panel(fb, y, panel, now_ms, budget_us);
+        y += HUD_PANEL_HEIGHT;
+    }
+
+    char line[48];
+    snprintf(line, sizeof(line), "DROPPED %llu  LATE %llu  A/V %+ldMS",
+             perf_stats_counter(PERF_COUNTER_DROPPED),
+             perf_stats_counter(PERF_COUNTER_LATE), perf_stats_av_offset_ms());
+    draw_text(fb, 2, y, line, HUD_WHITE);
+    snprintf(line, sizeof(line), "IN PLACE %llu  %lluKB",
+             perf_stats_counter(PERF_COUNTER_COPIES_AVOIDED),
+             perf_stats_counter(PERF_COUNTER_BYTES_AVOIDED) / 1024);
+    draw_text(fb, 2, y + HUD_LINE_HEIGHT, line, HUD_WHITE);
+
+    gfxFlushBuffers();
+    gfxScreenSwapBuffers(GFX_BOTTOM, false);
+}
+
+void n3ds_perf_hud_set_visible(bool visible) {
+    if (visible == hud_visible) {
+        return;
+    }
+    hud_visible = visible;
+    perf_stats_set_enabled(visible);
+    if (visible) {
+        // Draw right away so the toggle is acknowledged
+        last_draw_ms = perf_stats_now_ms();
+        draw_hud();
+    }
+}
+
+bool n3ds_perf_hud_visible() { return hud_visible; }
+
+void n3ds_perf_hud_update() {
+    if (!hud_visible) {
+        return;
+    }
+    u32 now_ms = perf_stats_now_ms();
+    if (now_ms - last_draw_ms >= N3DS_PERF_HUD_PERIOD_MS) {
+        last_draw_ms = now_ms;
+        draw_hud();
+    }
+}
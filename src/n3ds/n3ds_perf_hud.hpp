@@ -0,0 +1,33 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <3ds.h>
+
+// Buttons that show or hide the HUD while streaming
+#define N3DS_PERF_HUD_BUTTONS (KEY_SELECT | KEY_L | KEY_R | KEY_DDOWN)
+// How often the HUD is redrawn while it is visible
+#define N3DS_PERF_HUD_PERIOD_MS 250
+
+// Performance overlay on the bottom screen. Stats are only collected while it
+// is visible, and the caller is responsible for restoring whatever the bottom
+// screen showed before once it is hidden.
+void n3ds_perf_hud_set_visible(bool visible);
+bool n3ds_perf_hud_visible();
+// Redraws the HUD if it is visible and the last draw is older than the period
+void n3ds_perf_hud_update();
@@ -0,0 +1,64 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "n3ds_thread.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+
+#define N3DS_THREAD_STACK_SIZE (64 * 1024)
+#define N3DS_THREAD_DEFAULT_CORE -2
+#define N3DS_THREAD_PRIO_MIN 0x18
+#define N3DS_THREAD_PRIO_MAX 0x3F
+// Percentage of the system core the application asks for
+#define N3DS_SYS_CORE_TIME_LIMIT 30
+
+static bool sys_core_enabled = false;
+
+static int resolve_core(int core_id) {
+    if (core_id == N3DS_SYS_CORE) {
+        if (!sys_core_enabled) {
+            sys_core_enabled =
+                R_SUCCEEDED(APT_SetAppCpuTimeLimit(N3DS_SYS_CORE_TIME_LIMIT));
+        }
+        return sys_core_enabled ? core_id : N3DS_THREAD_DEFAULT_CORE;
+    } else if (core_id >= N3DS_EXTRA_CORE) {
+        bool is_new_3ds = false;
+        APT_CheckNew3DS(&is_new_3ds);
+        return is_new_3ds ? core_id : N3DS_THREAD_DEFAULT_CORE;
+    }
+    return core_id;
+}
+
+Thread n3ds_thread_create(ThreadFunc entry, void *arg, int core_id,
+                          int priority_offset) {
+    s32 priority = 0x30;
+    svcGetThreadPriority(&priority, CUR_THREAD_HANDLE);
+    priority = std::clamp<s32>(priority + priority_offset, N3DS_THREAD_PRIO_MIN,
+                               N3DS_THREAD_PRIO_MAX);
+
+    int resolved_core = resolve_core(core_id);
+    Thread thread = threadCreate(entry, arg, N3DS_THREAD_STACK_SIZE, priority,
+                                 resolved_core, false);
+    if (thread == NULL && resolved_core != N3DS_THREAD_DEFAULT_CORE) {
+        fprintf(stderr, "Core %d unavailable, using the default core\n",
+                resolved_core);
+        thread = threadCreate(entry, arg, N3DS_THREAD_STACK_SIZE, priority,
+                              N3DS_THREAD_DEFAULT_CORE, false);
+    }
+    return thread;
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <3ds.h>
+
+// Core the application normally runs on
+#define N3DS_APP_CORE 0
+// Core shared with the system, usable once the app is granted time on it
+#define N3DS_SYS_CORE 1
+// Additional cores only present on the New 3DS
+#define N3DS_EXTRA_CORE 2
+
+// Creates a joinable thread on the requested core, falling back to the
+// default core when that core isn't available to the application. A negative
+// priority_offset runs the thread ahead of the calling thread.
+Thread n3ds_thread_create(ThreadFunc entry, void *arg, int core_id,
+                          int priority_offset = 0);
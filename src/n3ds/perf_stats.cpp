@@ -0,0 +1,97 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "perf_stats.hpp"
+
+#include <chrono>
+
+struct perf_stats_ring {
+    std::atomic<uint32_t> values[PERF_STATS_SAMPLES];
+    std::atomic<uint32_t> times_ms[PERF_STATS_SAMPLES];
+    // Samples written so far, only ever advanced by the writer
+    std::atomic<uint32_t> head;
+};
+
+std::atomic<bool> perf_stats_active(false);
+
+static perf_stats_ring rings[PERF_STAT_COUNT];
+static std::atomic<uint64_t> counters[PERF_COUNTER_COUNT];
+
+void perf_stats_set_enabled(bool enabled) {
+    if (enabled && !perf_stats_enabled()) {
+        // Don't show what was left over from the last time it was visible
+        for (perf_stats_ring &ring : rings) {
+            ring.head.store(0, std::memory_order_relaxed);
+        }
+    }
+    perf_stats_active.store(enabled, std::memory_order_release);
+}
+
+uint32_t perf_stats_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void perf_stats_push(perf_stat stat, uint32_t value) {
+    perf_stats_ring &ring = rings[stat];
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    uint32_t idx = head % PERF_STATS_SAMPLES;
+    ring.values[idx].store(value, std::memory_order_relaxed);
+    ring.times_ms[idx].store(perf_stats_now_ms(), std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void perf_stats_set_counter(perf_counter counter, uint64_t value) {
+    counters[counter].store(value, std::memory_order_relaxed);
+}
+
+uint64_t perf_stats_counter(perf_counter counter) {
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+void perf_stats_read(perf_stat stat, perf_stats_series *out) {
+    perf_stats_ring &ring = rings[stat];
+    uint32_t head = ring.head.load(std::memory_order_acquire);
+    uint32_t count = head < PERF_STATS_SAMPLES ? head : PERF_STATS_SAMPLES;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t idx = (head - count + i) % PERF_STATS_SAMPLES;
+        out->values[i] = ring.values[idx].load(std::memory_order_relaxed);
+        out->times_ms[i] = ring.times_ms[idx].load(std::memory_order_relaxed);
+    }
+    out->count = count;
+}
+
+static uint32_t perf_stats_average(perf_stat stat) {
+    perf_stats_series series;
+    perf_stats_read(stat, &series);
+    uint64_t sum = 0;
+    for (int i = 0; i < series.count; i++) {
+        sum += series.values[i];
+    }
+    return series.count ? sum / series.count : 0;
+}
+
+int32_t perf_stats_av_offset_ms() {
+    uint32_t video_us = perf_stats_average(PERF_STAT_NETWORK) +
+                        perf_stats_average(PERF_STAT_DECODE) +
+                        perf_stats_average(PERF_STAT_CONVERT) +
+                        perf_stats_average(PERF_STAT_PRESENT) +
+                        perf_stats_average(PERF_STAT_VBLANK_OFFSET);
+    return (int32_t)perf_stats_average(PERF_STAT_AUDIO_QUEUE) -
+           (int32_t)(video_us / 1000);
+}
@@ -0,0 +1,95 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the rings can be built and exercised on the host.
+
+#include <atomic>
+#include <cstdint>
+
+// Per-frame values shown by the performance HUD
+enum perf_stat {
+    // Time from the first packet of a frame arriving to its submission (us)
+    PERF_STAT_NETWORK,
+    // Bitstream decode (us)
+    PERF_STAT_DECODE,
+    // YUV to RGB conversion, or MVD rendering its output (us)
+    PERF_STAT_CONVERT,
+    // GPU submit to swap (us)
+    PERF_STAT_PRESENT,
+    // Swap to the VBlank that shows the frame (us)
+    PERF_STAT_VBLANK_OFFSET,
+    // Audio waiting to be played (ms)
+    PERF_STAT_AUDIO_QUEUE,
+    // Encoded frame size, summed over time for the bitrate (bytes)
+    PERF_STAT_FRAME_BYTES,
+    PERF_STAT_COUNT
+};
+
+// Running values owned by a single stage
+enum perf_counter {
+    PERF_COUNTER_DROPPED,
+    PERF_COUNTER_LATE,
+    // Measured display refresh period (us), the budget every stage has
+    PERF_COUNTER_FRAME_PERIOD,
+    // Decode units handed to MVD in place, and the bytes not copied
+    PERF_COUNTER_COPIES_AVOIDED,
+    PERF_COUNTER_BYTES_AVOIDED,
+    PERF_COUNTER_COUNT
+};
+
+#define PERF_STATS_SAMPLES 64
+
+// A copy of the most recent samples of one stat, oldest first
+struct perf_stats_series {
+    uint32_t values[PERF_STATS_SAMPLES];
+    uint32_t times_ms[PERF_STATS_SAMPLES];
+    int count;
+};
+
+extern std::atomic<bool> perf_stats_active;
+
+// Recording is skipped entirely while nothing displays the stats
+void perf_stats_set_enabled(bool enabled);
+
+inline bool perf_stats_enabled() {
+    return perf_stats_active.load(std::memory_order_relaxed);
+}
+
+// Each stat must only be recorded from one thread at a time. Readers never
+// block the writer, a sample overwritten mid-read is shown torn at worst.
+void perf_stats_push(perf_stat stat, uint32_t value);
+
+inline void perf_stats_record(perf_stat stat, uint32_t value) {
+    if (perf_stats_enabled()) {
+        perf_stats_push(stat, value);
+    }
+}
+
+void perf_stats_set_counter(perf_counter counter, uint64_t value);
+uint64_t perf_stats_counter(perf_counter counter);
+
+void perf_stats_read(perf_stat stat, perf_stats_series *out);
+
+// How far audio trails video, in ms. Compares the average audio queue with
+// the average time a frame spends from arrival to its swap, negative when
+// audio is ahead.
+int32_t perf_stats_av_offset_ms();
+
+// Milliseconds on the clock used for sample times
+uint32_t perf_stats_now_ms();
@@ -23,13 +23,17 @@
 #include "loop.h"
 #include "platform_main.h"
 
+#include "n3ds/host_cache.hpp"
 #include "n3ds/n3ds_connection.hpp"
+#include "n3ds/n3ds_perf_hud.hpp"
 #include "n3ds/pair_record.hpp"
 
 #include "audio/audio.h"
 #include "video/video.h"
 
+#include "input/n3ds/InputPollClock.hpp"
 #include "input/n3ds_input.hpp"
+#include "n3ds/n3ds_thread.hpp"
 
 #include <3ds.h>
 
@@ -37,10 +41,14 @@
 
 #include <client.h>
 #include <discover.h>
+#include <probe.h>
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <atomic>
 #include <exception>
 #include <malloc.h>
+#include <math.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <openssl/rand.h>
@@ -60,6 +68,30 @@
 
 #define MAX_INPUT_CHAR 60
 
+// Range of the input polling rate, HID itself doesn't update any faster
+#define INPUT_POLL_RATE_MIN 60
+#define INPUT_POLL_RATE_MAX 1000
+// Poll timing is logged this often in debug mode
+#define INPUT_POLL_LOG_MS 5000
+// How often the main thread checks whether the stream has ended
+#define STREAM_CHECK_NS 100000000LL
+
+// Stick travel below this during calibration means the stick wasn't moved
+#define CALIBRATION_MIN_STICK_RANGE 50
+// Frames the accelerometer is averaged over, about a second
+#define CALIBRATION_ACCEL_FRAMES 60
+
+// Gyro aim filtering, the sensitivity is configurable
+#define GYRO_AIM_DEAD_BAND_DPS 0.5f
+#define GYRO_AIM_MIN_CUTOFF_HZ 1.0f
+#define GYRO_AIM_BETA 0.05f
+
+// Saved hosts that haven't answered by then are listed as offline
+#define HOST_PROBE_TIMEOUT_MS 1500
+
+// A client.pem and key.pem placed here are used instead of generating a pair
+#define CERT_IMPORT_DIR MOONLIGHT_3DS_PATH "/import"
+
 static u32 *SOC_buffer = NULL;
 
 static PrintConsole topScreen;
@@ -178,11 +210,50 @@ static std::string prompt_for_action(PSERVER_DATA server) {
     return actions[idx];
 }
 
-static std::string prompt_for_address() {
+static void label_probe_result(const PROBE_RESULT *result, void *context) {
+    auto labels = (std::vector<std::string> *)context;
+    std::string status;
+    if (result->status != GS_OK) {
+        status = "offline";
+    } else {
+        if (result->pairing == PROBE_PAIRED) {
+            status = "paired";
+        } else if (result->pairing == PROBE_NOT_PAIRED) {
+            status = "not paired";
+        } else {
+            status = "online";
+        }
+        if (result->currentGame != 0) {
+            status += ", streaming";
+        }
+    }
+    (*labels)[result->index] += " (" + status + ")";
+}
+
+static std::string prompt_for_address(PCONFIGURATION config) {
     auto address_list = list_paired_addresses();
+
+    // Ask every saved host for its status at once, so none of them can hold
+    // up the list
+    std::vector<std::string> labels = address_list;
+    if (!address_list.empty()) {
+        printf("Checking saved hosts...\n");
+        std::vector<const char *> addresses;
+        for (auto &address : address_list) {
+            addresses.push_back(address.c_str());
+        }
+        const char *unique_id = gs_unique_id(config->key_dir);
+        if (unique_id != NULL) {
+            gs_probe_hosts(addresses.data(), addresses.size(), config->port,
+                           config->key_dir, unique_id, HOST_PROBE_TIMEOUT_MS,
+                           label_probe_result, &labels);
+        }
+        consoleClear();
+    }
+
     address_list.push_back("new");
-    int idx =
-        console_selection_prompt("Select a server address", address_list, 0);
+    labels.push_back("new");
+    int idx = console_selection_prompt("Select a server address", labels, 0);
     if (idx < 0) {
         return "";
     } else if (address_list[idx] != "new") {
@@ -229,6 +300,41 @@ static int prompt_for_display_type(int default_val) {
     return idx;
 }
 
+// Names as stored in the config file, "none" turns the ratchet off
+static const std::vector<std::string> gyro_ratchet_buttons = {
+    "zl", "zr", "l", "r", "none",
+};
+
+static char *prompt_for_gyro_ratchet_button(char *default_val) {
+    int default_idx = 0;
+    for (size_t i = 0; i < gyro_ratchet_buttons.size(); i++) {
+        if (gyro_ratchet_buttons[i] == default_val) {
+            default_idx = i;
+        }
+    }
+    int idx = console_selection_prompt(
+        "Hold to turn without moving the cursor in gyro aim. The button is "
+        "no longer passed on to the host while gyro aim is on.",
+        gyro_ratchet_buttons, default_idx);
+    if (idx < 0) {
+        return default_val;
+    }
+    return (char *)gyro_ratchet_buttons[idx].c_str();
+}
+
+static u32 parse_gyro_ratchet_button(const char *name) {
+    if (strcmp(name, "none") == 0) {
+        return 0;
+    } else if (strcmp(name, "zr") == 0) {
+        return KEY_ZR;
+    } else if (strcmp(name, "l") == 0) {
+        return KEY_L;
+    } else if (strcmp(name, "r") == 0) {
+        return KEY_R;
+    }
+    return KEY_ZL;
+}
+
 static int prompt_for_int(std::string initial_text) {
     char *setting_buff = (char *)malloc(MAX_INPUT_CHAR);
     memset(setting_buff, 0, MAX_INPUT_CHAR);
@@ -244,6 +350,95 @@ static int prompt_for_int(std::string initial_text) {
     return std::stoi(setting_str);
 }
 
+// Waits for A or B, returns true for A
+static bool wait_for_confirm() {
+    while (aptMainLoop()) {
+        gfxSwapBuffers();
+        gfxFlushBuffers();
+        gspWaitForVBlank();
+
+        hidScanInput();
+        u32 kDown = hidKeysDown();
+        if (kDown & (KEY_A | KEY_B)) {
+            return kDown & KEY_A;
+        }
+    }
+    return false;
+}
+
+// Measures how far the sticks actually travel and what the accelerometer
+// reads for gravity, both vary a little between systems
+static void calibrate_input(PCONFIGURATION config) {
+    int circle_pad_max = 0;
+    int c_stick_max = 0;
+    u32 kDown = 0;
+    consoleClear();
+    printf("Move the circle pad and C-stick around their edges\n");
+    printf("Press A to save, B to cancel\n\n");
+    while (aptMainLoop()) {
+        gfxSwapBuffers();
+        gfxFlushBuffers();
+        gspWaitForVBlank();
+
+        hidScanInput();
+        kDown = hidKeysDown();
+        if (kDown & (KEY_A | KEY_B)) {
+            break;
+        }
+
+        circlePosition pos;
+        hidCircleRead(&pos);
+        circle_pad_max =
+            std::max(circle_pad_max, (int)hypotf(pos.dx, pos.dy));
+        hidCstickRead(&pos);
+        c_stick_max = std::max(c_stick_max, (int)hypotf(pos.dx, pos.dy));
+        printf("\rCircle pad %3d  C-stick %3d", circle_pad_max, c_stick_max);
+    }
+    if (!(kDown & KEY_A)) {
+        return;
+    }
+    // Sticks that were barely moved, or aren't there, keep their old range
+    if (circle_pad_max >= CALIBRATION_MIN_STICK_RANGE) {
+        config->circlepad_range = circle_pad_max;
+    }
+    if (c_stick_max >= CALIBRATION_MIN_STICK_RANGE) {
+        config->cstick_range = c_stick_max;
+    }
+
+    consoleClear();
+    printf("Lay the system flat and keep it still\n");
+    printf("Press A to measure, B to skip\n");
+    if (!wait_for_confirm()) {
+        return;
+    }
+    HIDUSER_EnableAccelerometer();
+    float sum = 0;
+    int samples = 0;
+    for (int i = 0; i < CALIBRATION_ACCEL_FRAMES && aptMainLoop(); i++) {
+        gfxSwapBuffers();
+        gfxFlushBuffers();
+        gspWaitForVBlank();
+
+        hidScanInput();
+        accelVector accel;
+        hidAccelRead(&accel);
+        float magnitude =
+            sqrtf(accel.x * accel.x + accel.y * accel.y + accel.z * accel.z);
+        // Readings are zero until the sensor has started up
+        if (magnitude > 0) {
+            sum += magnitude;
+            samples++;
+        }
+    }
+    HIDUSER_DisableAccelerometer();
+    if (samples > 0) {
+        config->accel_range = sum / samples;
+    }
+    printf("Circle pad %d, C-stick %d, 1 g reads %d\n",
+           config->circlepad_range, config->cstick_range, config->accel_range);
+    wait_for_button();
+}
+
 static void prompt_for_stream_settings(PCONFIGURATION config) {
     std::vector<std::string> setting_names = {
         "width",
@@ -251,10 +446,21 @@ static void prompt_for_stream_settings(PCONFIGURATION config) {
         "fps",
         "display_type",
         "motion_controls",
+        "input_poll_rate",
+        "stick_deadzone",
+        "stick_axial_deadzone",
+        "stick_anti_deadzone",
+        "stick_curve",
+        "calibrate_input",
+        "gyro_aim",
+        "gyro_aim_sensitivity",
+        "gyro_ratchet_button",
         "bitrate",
         "packetsize",
         "sops",
         "localaudio",
+        "audio_latency",
+        "audio_low_latency",
         "quitappafter",
         "viewonly",
         "hwdecode",
@@ -292,6 +498,34 @@ static void prompt_for_stream_settings(PCONFIGURATION config) {
         } else if ("motion_controls" == setting_names[idx]) {
             config->motion_controls = prompt_for_boolean(
                 "Enable Motion Controls", config->motion_controls);
+        } else if ("input_poll_rate" == setting_names[idx]) {
+            config->input_poll_rate =
+                prompt_for_int(std::to_string(config->input_poll_rate));
+        } else if ("stick_deadzone" == setting_names[idx]) {
+            config->stick_deadzone =
+                prompt_for_int(std::to_string(config->stick_deadzone));
+        } else if ("stick_axial_deadzone" == setting_names[idx]) {
+            config->stick_axial_deadzone =
+                prompt_for_int(std::to_string(config->stick_axial_deadzone));
+        } else if ("stick_anti_deadzone" == setting_names[idx]) {
+            config->stick_anti_deadzone =
+                prompt_for_int(std::to_string(config->stick_anti_deadzone));
+        } else if ("stick_curve" == setting_names[idx]) {
+            config->stick_curve =
+                prompt_for_int(std::to_string(config->stick_curve));
+        } else if ("calibrate_input" == setting_names[idx]) {
+            calibrate_input(config);
+        } else if ("gyro_aim" == setting_names[idx]) {
+            config->gyro_aim = prompt_for_boolean(
+                "Aim the mouse with the gyroscope, hold the ratchet button to "
+                "reposition",
+                config->gyro_aim);
+        } else if ("gyro_aim_sensitivity" == setting_names[idx]) {
+            config->gyro_aim_sensitivity =
+                prompt_for_int(std::to_string(config->gyro_aim_sensitivity));
+        } else if ("gyro_ratchet_button" == setting_names[idx]) {
+            config->gyro_ratchet_button =
+                prompt_for_gyro_ratchet_button(config->gyro_ratchet_button);
         } else if ("fps" == setting_names[idx]) {
             config->stream.fps =
                 prompt_for_int(std::to_string(config->stream.fps));
@@ -307,6 +541,13 @@ static void prompt_for_stream_settings(PCONFIGURATION config) {
         } else if ("localaudio" == setting_names[idx]) {
             config->localaudio =
                 prompt_for_boolean("Enable local audio", config->localaudio);
+        } else if ("audio_latency" == setting_names[idx]) {
+            config->audio_latency =
+                prompt_for_int(std::to_string(config->audio_latency));
+        } else if ("audio_low_latency" == setting_names[idx]) {
+            config->audio_low_latency = prompt_for_boolean(
+                "Use as few audio buffers as playback allows",
+                config->audio_low_latency);
         } else if ("quitappafter" == setting_names[idx]) {
             config->quitappafter = prompt_for_boolean(
                 "Quit app after streaming", config->quitappafter);
@@ -370,38 +611,208 @@ static void init_3ds() {
     }
 }
 
+struct AppListRefresh {
+    PSERVER_DATA server;
+    PAPP_LIST list;
+    int ret;
+};
+
+static void app_list_refresh_main(void *arg) {
+    AppListRefresh *refresh = (AppListRefresh *)arg;
+    refresh->ret = gs_applist(refresh->server, &refresh->list);
+}
+
+static void free_app_list(PAPP_LIST list) {
+    while (list != NULL) {
+        PAPP_LIST next = list->next;
+        free(list->name);
+        free(list);
+        list = next;
+    }
+}
+
+static HostCache host_cache_from_server(PSERVER_DATA server, PAPP_LIST list) {
+    HostCache cache;
+    cache.app_version = server->serverInfo.serverInfoAppVersion;
+    for (; list != NULL; list = list->next) {
+        cache.apps.push_back({list->id, list->name ? list->name : ""});
+    }
+    return cache;
+}
+
+static bool same_app_ids(const HostCache &a, const HostCache &b) {
+    if (a.apps.size() != b.apps.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.apps.size(); i++) {
+        if (a.apps[i].id != b.apps[i].id) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static int prompt_for_app_id(PSERVER_DATA server) {
-    PAPP_LIST list = NULL;
-    if (gs_applist(server, &list) != GS_OK) {
-        printf("Can't get app list\n");
-        return -1;
+    std::string unique_id = server->uniqueId ? server->uniqueId : "";
+    HostCache cache;
+    // A host update can change its apps without changing how many there are
+    bool cached =
+        load_host_cache(unique_id, &cache) &&
+        cache.app_version == server->serverInfo.serverInfoAppVersion;
+
+    // The cached list is shown right away while the host is asked for the
+    // current one in the background
+    AppListRefresh refresh = {server, NULL, GS_FAILED};
+    Thread refresh_thread = NULL;
+    if (cached) {
+        refresh_thread = n3ds_thread_create(app_list_refresh_main, &refresh,
+                                            N3DS_APP_CORE, 1);
+    }
+    if (refresh_thread == NULL) {
+        app_list_refresh_main(&refresh);
+        if (refresh.ret != GS_OK) {
+            printf("Can't get app list\n");
+            return -1;
+        }
+        cache = host_cache_from_server(server, refresh.list);
+        free_app_list(refresh.list);
+        save_host_cache(unique_id, cache);
     }
 
-    std::vector<std::string> app_names;
-    std::vector<int> app_ids;
-    while (list != NULL) {
-        printf("%d. %s\n", list->id, list->name);
-        app_names.push_back(std::string(list->name));
-        app_ids.push_back(list->id);
-        list = list->next;
+    while (true) {
+        std::vector<std::string> app_names;
+        for (const CachedApp &app : cache.apps) {
+            printf("%d. %s\n", app.id, app.name.c_str());
+            app_names.push_back(app.name);
+        }
+        int id_idx = console_selection_prompt("Select an app", app_names, 0);
+
+        if (refresh_thread != NULL) {
+            // A slow host doesn't get to hold up the stream, the cached ID
+            // is used unless the current list already came in. The connection
+            // is needed for the launch, so the refresh is cut short.
+            if (R_FAILED(threadJoin(refresh_thread, 0))) {
+                gs_abort_requests(true);
+                threadJoin(refresh_thread, U64_MAX);
+                gs_abort_requests(false);
+            }
+            threadFree(refresh_thread);
+            refresh_thread = NULL;
+            if (refresh.ret == GS_OK) {
+                HostCache current =
+                    host_cache_from_server(server, refresh.list);
+                free_app_list(refresh.list);
+                save_host_cache(unique_id, current);
+                // Nothing was picked, there is no selection to check
+                if (id_idx == -1) {
+                    return -1;
+                }
+                if (!same_app_ids(current, cache)) {
+                    // The selection may point at an app that is gone
+                    printf("The app list has changed\n");
+                    cache = current;
+                    continue;
+                }
+            }
+        }
+
+        if (id_idx == -1) {
+            return -1;
+        }
+        return cache.apps[id_idx].id;
+    }
+}
+
+static inline void toggle_perf_hud() {
+    // Only while the video leaves the bottom screen free
+    if (N3DS_RENDER_TYPE != RENDER_DEFAULT) {
+        return;
+    }
+    u32 kHeld = hidKeysHeld();
+    if ((hidKeysDown() & N3DS_PERF_HUD_BUTTONS) &&
+        (kHeld & N3DS_PERF_HUD_BUTTONS) == N3DS_PERF_HUD_BUTTONS) {
+        n3ds_perf_hud_set_visible(!n3ds_perf_hud_visible());
+        if (!n3ds_perf_hud_visible()) {
+            n3dsinput_redraw_touch();
+        }
+    }
+}
+
+static std::atomic<bool> input_thread_running(false);
+static std::atomic<bool> input_quit(false);
+static LightEvent input_quit_event;
+
+static inline u64 ticks_to_us(u64 ticks) {
+    return ticks * 1000000ULL / SYSCLOCK_ARM11;
+}
+
+// Polls input on a fixed schedule. HID events don't fire for analog and
+// motion changes, so waiting on them leaves the sticks and gyro sampled far
+// below the rate HID updates them at. Everything that scans HID or draws on
+// the bottom screen runs here so it stays on one thread.
+static void input_thread_main(void *arg) {
+    PCONFIGURATION config = (PCONFIGURATION)arg;
+    int rate = config->input_poll_rate;
+    rate = rate < INPUT_POLL_RATE_MIN ? INPUT_POLL_RATE_MIN : rate;
+    rate = rate > INPUT_POLL_RATE_MAX ? INPUT_POLL_RATE_MAX : rate;
+    InputPollClock clock(SYSCLOCK_ARM11 / rate);
+    if (config->debug_level > 0) {
+        printf("Input: polling at %d Hz\n", rate);
     }
 
-    int id_idx = console_selection_prompt("Select an app", app_names, 0);
-    if (id_idx == -1) {
-        return -1;
+    u64 last_log = svcGetSystemTick();
+    while (input_thread_running) {
+        u64 now = svcGetSystemTick();
+        u64 deadline = clock.on_poll(now);
+        if (n3dsinput_handle_event()) {
+            input_quit = true;
+            LightEvent_Signal(&input_quit_event);
+        }
+        toggle_perf_hud();
+        n3ds_perf_hud_update();
+
+        if (config->debug_level > 0 &&
+            ticks_to_us(now - last_log) >= INPUT_POLL_LOG_MS * 1000ULL) {
+            printf("Input: %d Hz, jitter avg %llu us max %llu us, %llu "
+                   "polls missed\n",
+                   rate, ticks_to_us(clock.average_jitter()),
+                   ticks_to_us(clock.max_jitter), clock.missed);
+            last_log = now;
+        }
+
+        now = svcGetSystemTick();
+        if (deadline > now) {
+            svcSleepThread((deadline - now) * 1000000000ULL / SYSCLOCK_ARM11);
+        }
     }
-    return app_ids[id_idx];
 }
 
 static inline void stream_loop(PCONFIGURATION config) {
-    bool done = false;
-    while (!done && aptMainLoop()) {
-        done = n3ds_connection_closed;
-        if (!config->viewonly) {
-            done |= n3dsinput_handle_event();
+    Thread input_thread = NULL;
+    input_quit = false;
+    LightEvent_Init(&input_quit_event, RESET_ONESHOT);
+    if (!config->viewonly) {
+        input_thread_running = true;
+        // Ahead of this thread, which only checks for the end of the stream
+        input_thread =
+            n3ds_thread_create(input_thread_main, config, N3DS_APP_CORE, -1);
+        if (input_thread == NULL) {
+            fprintf(stderr, "Failed to start the input thread\n");
+            input_thread_running = false;
+            return;
         }
-        hidWaitForAnyEvent(true, 0, 1000000000);
     }
+
+    while (!n3ds_connection_closed && !input_quit && aptMainLoop()) {
+        LightEvent_WaitTimeout(&input_quit_event, STREAM_CHECK_NS);
+    }
+
+    if (input_thread != NULL) {
+        input_thread_running = false;
+        threadJoin(input_thread, U64_MAX);
+        threadFree(input_thread);
+    }
+    n3ds_perf_hud_set_visible(false);
 }
 
 static void stream(PSERVER_DATA server, PCONFIGURATION config, int appId) {
@@ -430,6 +841,8 @@ static void stream(PSERVER_DATA server, PCONFIGURATION config, int appId) {
     }
 
     n3ds_audio_disabled = config->localaudio;
+    n3ds_audio_latency_ms = config->audio_latency;
+    n3ds_audio_low_latency = config->audio_low_latency;
     n3ds_connection_debug = config->debug_level;
     N3DS_RENDER_TYPE = static_cast<n3ds_render_type>(config->display_type);
 
@@ -494,14 +907,113 @@ static void stream(PSERVER_DATA server, PCONFIGURATION config, int appId) {
     }
 }
 
+struct CertKeygen {
+    const char *key_dir;
+    MKCERT_KEY_TYPE key_type;
+    std::atomic<int> candidates;
+    std::atomic<bool> done;
+    int ret;
+};
+
+static void keygen_progress(int stage, int count, void *context) {
+    CertKeygen *keygen = (CertKeygen *)context;
+    // Stage 0 is reported for every prime candidate tried
+    if (stage == 0) {
+        keygen->candidates++;
+    }
+}
+
+static void keygen_thread_main(void *arg) {
+    CertKeygen *keygen = (CertKeygen *)arg;
+    keygen->ret = gs_generate_cert(keygen->key_dir, keygen->key_type,
+                                   keygen_progress, keygen);
+    keygen->done = true;
+}
+
+static MKCERT_KEY_TYPE parse_key_type(const char *key_type) {
+    if (strcmp(key_type, "rsa1024") == 0) {
+        return MKCERT_KEY_RSA_1024;
+    } else if (strcmp(key_type, "ecp256") == 0) {
+        return MKCERT_KEY_EC_P256;
+    }
+    return MKCERT_KEY_RSA_2048;
+}
+
+static bool generate_client_cert(PCONFIGURATION config) {
+    CertKeygen keygen;
+    keygen.key_dir = config->key_dir;
+    keygen.key_type = parse_key_type(config->key_type);
+    keygen.candidates = 0;
+    keygen.done = false;
+    keygen.ret = GS_FAILED;
+
+    // Generating an RSA-2048 key takes a while on the ARM11, keep the
+    // screen alive while it runs
+    Thread keygen_thread =
+        n3ds_thread_create(keygen_thread_main, &keygen, N3DS_APP_CORE, 1);
+    if (keygen_thread == NULL) {
+        printf("Generating certificate...\n");
+        keygen_thread_main(&keygen);
+    } else {
+        const char spinner[] = "|/-\\";
+        // Only RSA searches for primes, EC keys have no progress to show
+        bool count_candidates = keygen.key_type != MKCERT_KEY_EC_P256;
+        int frame = 0;
+        while (!keygen.done) {
+            char symbol = spinner[(frame++ / 8) % 4];
+            if (count_candidates) {
+                printf("\rGenerating certificate %c %d candidates tested",
+                       symbol, keygen.candidates.load());
+            } else {
+                printf("\rGenerating certificate %c", symbol);
+            }
+            gfxFlushBuffers();
+            gfxSwapBuffers();
+            gspWaitForVBlank();
+        }
+        threadJoin(keygen_thread, U64_MAX);
+        threadFree(keygen_thread);
+        printf("\n");
+    }
+    return keygen.ret == GS_OK;
+}
+
+// Makes sure a client certificate exists before the first gs_init, which
+// would otherwise generate one without any feedback
+static void ensure_client_cert(PCONFIGURATION config) {
+    if (gs_has_cert(config->key_dir)) {
+        return;
+    }
+
+    int ret = gs_import_cert(config->key_dir, CERT_IMPORT_DIR);
+    if (ret == GS_OK) {
+        printf("Imported the client certificate from %s\n", CERT_IMPORT_DIR);
+        return;
+    } else if (ret != GS_IO_ERROR) {
+        printf("Can't import the client certificate: %s\n", gs_error);
+    }
+
+    // Going on without one would have gs_init generate an RSA-2048 key on
+    // the main thread, with no feedback
+    while (!generate_client_cert(config)) {
+        std::string prompt =
+            std::string("Can't generate the client certificate: ") + gs_error;
+        std::vector<std::string> options = {"retry", "quit"};
+        if (console_selection_prompt(prompt, options, 0) != 0) {
+            exit(1);
+        }
+    }
+}
+
 int main_loop(int argc, char *argv[]) {
     init_3ds();
 
     CONFIGURATION config;
     config_parse(argc, argv, &config);
+    ensure_client_cert(&config);
 
     while (aptMainLoop()) {
-        auto address_string = prompt_for_address();
+        auto address_string = prompt_for_address(&config);
         if (address_string.empty()) {
             continue;
         }
@@ -581,6 +1093,23 @@ int main_loop(int argc, char *argv[]) {
                     n3dsinput_init(touch_type, config.swap_face_buttons,
                                    config.swap_triggers_and_shoulders,
                                    config.use_triggers_for_mouse);
+                    StickProfile circle_pad = {
+                        config.circlepad_range, config.stick_deadzone,
+                        config.stick_axial_deadzone,
+                        config.stick_anti_deadzone, config.stick_curve};
+                    StickProfile c_stick = circle_pad;
+                    c_stick.range = config.cstick_range;
+                    n3dsinput_set_tuning(circle_pad, c_stick,
+                                         config.accel_range);
+                    if (config.gyro_aim) {
+                        GyroAimSettings gyro_aim = {
+                            (float)config.gyro_aim_sensitivity,
+                            GYRO_AIM_DEAD_BAND_DPS, GYRO_AIM_MIN_CUTOFF_HZ,
+                            GYRO_AIM_BETA};
+                        n3dsinput_set_gyro_aim(
+                            &gyro_aim, parse_gyro_ratchet_button(
+                                           config.gyro_ratchet_button));
+                    }
                 }
                 stream(&server, &config, appId);
 
@@ -615,6 +1144,9 @@ int main_loop(int argc, char *argv[]) {
                 } else {
                     printf("Succesfully unpaired\n");
                     remove_pair_address(config.address);
+                    if (server.uniqueId != NULL) {
+                        remove_host_cache(server.uniqueId);
+                    }
                     break;
                 }
             } else if (strcmp("quit stream", config.action) == 0) {
@@ -0,0 +1,89 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FramePacer.hpp"
+
+// Smoothing for the measured period and present cost, as a power of two
+#define PACER_EMA_SHIFT 3
+
+FramePacer::FramePacer(uint64_t nominal_period_in)
+    : nominal_period(nominal_period_in), vblank_period(nominal_period_in) {}
+
+void FramePacer::on_vblank(uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (last_vblank != 0) {
+        uint64_t measured = now - last_vblank;
+        // Ignore gaps from missed events (home menu, sleep)
+        if (measured > nominal_period / 2 && measured < nominal_period * 2) {
+            vblank_period =
+                vblank_period - (vblank_period >> PACER_EMA_SHIFT) +
+                (measured >> PACER_EMA_SHIFT);
+        }
+    }
+    last_vblank = now;
+}
+
+void FramePacer::on_present_cost(uint64_t ticks) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (present_cost == 0) {
+        present_cost = ticks;
+    } else {
+        present_cost = present_cost - (present_cost >> PACER_EMA_SHIFT) +
+                       (ticks >> PACER_EMA_SHIFT);
+    }
+}
+
+uint64_t FramePacer::next_vblank_locked(uint64_t now) {
+    if (last_vblank == 0 || now < last_vblank) {
+        return now;
+    }
+    uint64_t elapsed = (now - last_vblank) % vblank_period;
+    return now + (vblank_period - elapsed);
+}
+
+uint64_t FramePacer::present_deadline(uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (last_vblank == 0 || now < last_vblank) {
+        // No phase to pace against yet
+        return now;
+    }
+    uint64_t next_vblank = next_vblank_locked(now);
+    if (next_vblank < now + present_cost) {
+        // Too late for the next VBlank, aim for the first one still in reach
+        // rather than tearing into the current refresh
+        frames_late++;
+        uint64_t missing = now + present_cost - next_vblank;
+        next_vblank += (missing + vblank_period - 1) / vblank_period *
+                       vblank_period;
+    }
+    return next_vblank - present_cost;
+}
+
+uint64_t FramePacer::ticks_until_vblank(uint64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return next_vblank_locked(now) - now;
+}
+
+uint64_t FramePacer::period() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return vblank_period;
+}
+
+uint64_t FramePacer::late() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames_late;
+}
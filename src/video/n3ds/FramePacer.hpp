@@ -0,0 +1,59 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent, all times are in caller supplied ticks.
+
+#include <cstdint>
+#include <mutex>
+
+// Tracks the display's VBlank phase so frames can be presented just in time
+// for the next refresh, rather than whenever decoding happens to finish.
+class FramePacer {
+  public:
+    explicit FramePacer(uint64_t nominal_period_in);
+
+    // Called on every VBlank of the paced screen
+    void on_vblank(uint64_t now);
+
+    // Records how long a present took from submission to the swap
+    void on_present_cost(uint64_t ticks);
+
+    // Returns the time by which a present has to start to be shown at the
+    // next VBlank. If that time has already passed, the frame is counted as
+    // late and the deadline moves to the VBlank after, so the caller should
+    // pick the newest frame again once it is reached.
+    uint64_t present_deadline(uint64_t now);
+
+    // Ticks from now until the next VBlank
+    uint64_t ticks_until_vblank(uint64_t now);
+
+    uint64_t period();
+    uint64_t late();
+
+  private:
+    uint64_t next_vblank_locked(uint64_t now);
+
+  private:
+    uint64_t nominal_period;
+    uint64_t vblank_period;
+    uint64_t last_vblank = 0;
+    uint64_t present_cost = 0;
+    uint64_t frames_late = 0;
+    std::mutex mutex;
+};
@@ -0,0 +1,185 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the stage ordering and drop policy can be built and
+// exercised on the host.
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Bounded ring of reusable frame slots between a producer stage (decode) and a
+// consumer stage (convert/present). The producer never blocks: when every slot
+// is taken it recycles the oldest frame that is still waiting to be consumed.
+// At least 3 slots are needed so the producer always has a slot to write into
+// while the consumer holds one.
+template <typename T> class FrameRing {
+  public:
+    explicit FrameRing(size_t slot_count) : slots(slot_count) {}
+
+    size_t size() const { return slots.size(); }
+
+    // Direct slot access, only valid before the stages are started or after
+    // they have been stopped (setup and teardown of the slot contents).
+    T &at(size_t idx) { return slots[idx].value; }
+
+    T *acquire_write() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slot *target = nullptr;
+        for (Slot &slot : slots) {
+            if (slot.state == SLOT_FREE) {
+                target = &slot;
+                break;
+            }
+        }
+        if (!target) {
+            // Drop the oldest frame nobody has started consuming yet
+            for (Slot &slot : slots) {
+                if (slot.state == SLOT_READY &&
+                    (!target || slot.seq < target->seq)) {
+                    target = &slot;
+                }
+            }
+            if (!target) {
+                return nullptr;
+            }
+            frames_dropped++;
+        }
+        target->state = SLOT_WRITING;
+        return &target->value;
+    }
+
+    void commit_write(T *value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Slot *slot = find(value);
+            slot->seq = next_seq++;
+            slot->state = SLOT_READY;
+            frames_committed++;
+        }
+        ready_cond.notify_one();
+    }
+
+    void cancel_write(T *value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        find(value)->state = SLOT_FREE;
+    }
+
+    // Blocks until a frame is ready. Returns nullptr once the ring is stopped.
+    T *acquire_read() {
+        std::unique_lock<std::mutex> lock(mutex);
+        Slot *slot;
+        ready_cond.wait(lock, [&] {
+            return stopped || (slot = oldest_ready()) != nullptr;
+        });
+        if (stopped) {
+            return nullptr;
+        }
+        slot->state = SLOT_READING;
+        return &slot->value;
+    }
+
+    // Trades a frame the consumer holds for the newest ready frame, if there
+    // is one. Everything older is given up and counted as dropped.
+    T *take_newest(T *value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Slot *newest = nullptr;
+        for (Slot &slot : slots) {
+            if (slot.state == SLOT_READY &&
+                (!newest || slot.seq > newest->seq)) {
+                newest = &slot;
+            }
+        }
+        if (!newest) {
+            return value;
+        }
+        for (Slot &slot : slots) {
+            if (slot.state == SLOT_READY && &slot != newest) {
+                slot.state = SLOT_FREE;
+                frames_dropped++;
+            }
+        }
+        find(value)->state = SLOT_FREE;
+        frames_dropped++;
+        newest->state = SLOT_READING;
+        return &newest->value;
+    }
+
+    void release_read(T *value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        find(value)->state = SLOT_FREE;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        ready_cond.notify_all();
+    }
+
+    uint64_t committed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return frames_committed;
+    }
+
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return frames_dropped;
+    }
+
+  private:
+    enum SlotState { SLOT_FREE, SLOT_WRITING, SLOT_READY, SLOT_READING };
+    struct Slot {
+        T value{};
+        SlotState state = SLOT_FREE;
+        uint64_t seq = 0;
+    };
+
+    Slot *find(T *value) {
+        for (Slot &slot : slots) {
+            if (&slot.value == value) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    Slot *oldest_ready() {
+        Slot *oldest = nullptr;
+        for (Slot &slot : slots) {
+            if (slot.state == SLOT_READY &&
+                (!oldest || slot.seq < oldest->seq)) {
+                oldest = &slot;
+            }
+        }
+        return oldest;
+    }
+
+  private:
+    std::vector<Slot> slots;
+    std::mutex mutex;
+    std::condition_variable ready_cond;
+    uint64_t next_seq = 0;
+    uint64_t frames_committed = 0;
+    uint64_t frames_dropped = 0;
+    bool stopped = false;
+};
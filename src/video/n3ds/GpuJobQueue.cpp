@@ -0,0 +1,190 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "GpuJobQueue.hpp"
+
+#include <chrono>
+
+GpuJobQueue::GpuJobQueue(size_t max_jobs_in) : max_jobs(max_jobs_in) {}
+
+bool GpuJobQueue::submit(GpuJobTarget *target, const void *source,
+                         int tex_index, int timeout_ms, bool present_only) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!progress_cond.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                [&] { return jobs.size() < max_jobs; })) {
+        return false;
+    }
+
+    jobs.push_back({target, source, tex_index, present_only,
+                    present_only ? GPU_JOB_DRAWN : GPU_JOB_QUEUED, 0, 0});
+    pump();
+    return true;
+}
+
+bool GpuJobQueue::tex_in_use(const GpuJob &job) const {
+    for (const GpuJob &other : jobs) {
+        if (&other == &job) {
+            break;
+        }
+        if (other.target == job.target && other.tex_index == job.tex_index &&
+            other.state < GPU_JOB_DRAWN) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GpuJobQueue::fb_in_use(const GpuJob &job) const {
+    for (const GpuJob &other : jobs) {
+        if (&other == &job) {
+            break;
+        }
+        if (other.target == job.target) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GpuJobQueue::start_tile(GpuJob &job) {
+    job.state = GPU_JOB_TILING;
+    transfer_job = &job;
+    job.target->start_tile(job);
+}
+
+void GpuJobQueue::start_draw(GpuJob &job) {
+    job.state = GPU_JOB_DRAWING;
+    draw_job = &job;
+    job.target->start_draw(job);
+}
+
+void GpuJobQueue::start_present(GpuJob &job) {
+    job.state = GPU_JOB_PRESENTING;
+    job.transfer_index = 0;
+    job.transfer_count = job.target->present_transfer_count(job);
+    transfer_job = &job;
+    job.target->start_present(job, job.transfer_index);
+}
+
+// Starts whatever can run on the idle engines. Each stage is started in
+// submission order, presenting takes priority over tiling.
+void GpuJobQueue::pump() {
+    if (transfer_job == nullptr) {
+        for (GpuJob &job : jobs) {
+            if (job.state == GPU_JOB_DRAWN) {
+                start_present(job);
+                break;
+            }
+            if (job.state == GPU_JOB_QUEUED) {
+                if (!tex_in_use(job)) {
+                    start_tile(job);
+                }
+                break;
+            }
+        }
+    }
+
+    if (draw_job == nullptr) {
+        for (GpuJob &job : jobs) {
+            if (job.state < GPU_JOB_TILED) {
+                break;
+            }
+            if (job.state == GPU_JOB_TILED) {
+                if (!fb_in_use(job)) {
+                    start_draw(job);
+                }
+                break;
+            }
+        }
+    }
+}
+
+void GpuJobQueue::on_transfer_done() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        GpuJob *job = transfer_job;
+        if (job == nullptr) {
+            return;
+        }
+
+        if (job->state == GPU_JOB_TILING) {
+            job->state = GPU_JOB_TILED;
+            transfer_job = nullptr;
+        } else if (++job->transfer_index < job->transfer_count) {
+            job->target->start_present(*job, job->transfer_index);
+            return;
+        } else {
+            job->state = GPU_JOB_DONE;
+            transfer_job = nullptr;
+            job->target->finish(*job);
+
+            // Present-only jobs can overtake jobs still waiting on a draw
+            jobs.remove_if([&](const GpuJob &other) { return &other == job; });
+        }
+        pump();
+    }
+    progress_cond.notify_all();
+}
+
+void GpuJobQueue::on_draw_done() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (draw_job == nullptr) {
+            return;
+        }
+        draw_job->state = GPU_JOB_DRAWN;
+        draw_job = nullptr;
+        pump();
+    }
+    progress_cond.notify_all();
+}
+
+bool GpuJobQueue::wait_sources_released(int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return progress_cond.wait_for(
+        lock, std::chrono::milliseconds(timeout_ms), [&] {
+            for (const GpuJob &job : jobs) {
+                if (job.present_only || job.state < GPU_JOB_TILED) {
+                    return false;
+                }
+            }
+            return true;
+        });
+}
+
+bool GpuJobQueue::wait_idle(const GpuJobTarget *target, int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return progress_cond.wait_for(
+        lock, std::chrono::milliseconds(timeout_ms), [&] {
+            for (const GpuJob &job : jobs) {
+                if (target == nullptr || job.target == target) {
+                    return false;
+                }
+            }
+            return true;
+        });
+}
+
+void GpuJobQueue::reset() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.clear();
+        transfer_job = nullptr;
+        draw_job = nullptr;
+    }
+    progress_cond.notify_all();
+}
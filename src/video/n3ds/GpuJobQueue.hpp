@@ -0,0 +1,108 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the job ordering can be built and exercised on the
+// host with a stand-in GpuJobTarget.
+
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <mutex>
+
+// A frame moves through the transfer engine (tiling), the 3D engine (drawing)
+// and the transfer engine again (presenting) before it is done. Frames that
+// need no draw start out as drawn and are presented straight from the source.
+enum GpuJobState {
+    GPU_JOB_QUEUED,
+    GPU_JOB_TILING,
+    GPU_JOB_TILED,
+    GPU_JOB_DRAWING,
+    GPU_JOB_DRAWN,
+    GPU_JOB_PRESENTING,
+    GPU_JOB_DONE
+};
+
+class GpuJobTarget;
+
+struct GpuJob {
+    GpuJobTarget *target;
+    const void *source;
+    int tex_index;
+    bool present_only;
+    GpuJobState state;
+    int transfer_index;
+    int transfer_count;
+};
+
+// Issues the hardware work for each stage of a job. Every start_* call must
+// only kick off the operation; the queue learns about its completion through
+// on_transfer_done or on_draw_done. Calls are made with the queue locked.
+class GpuJobTarget {
+  public:
+    virtual ~GpuJobTarget() = default;
+    virtual void start_tile(const GpuJob &job) = 0;
+    virtual void start_draw(const GpuJob &job) = 0;
+    virtual int present_transfer_count(const GpuJob &job) = 0;
+    virtual void start_present(const GpuJob &job, int transfer) = 0;
+    // Called from the completion context once the last present transfer
+    // finished, this is where the display swap happens
+    virtual void finish(const GpuJob &job) = 0;
+};
+
+// Orders frames from every renderer onto the two GPU engines so submitting
+// returns right away and the next frame's tiling overlaps the current draw.
+// A target's texture is not re-tiled until the draw reading it is finished,
+// and its render buffer is not redrawn until the previous frame was presented.
+class GpuJobQueue {
+  public:
+    explicit GpuJobQueue(size_t max_jobs_in);
+
+    // Blocks while the queue is full. Returns false if no room was made
+    // within timeout_ms, which means the GPU stopped reporting completions.
+    bool submit(GpuJobTarget *target, const void *source, int tex_index,
+                int timeout_ms, bool present_only = false);
+
+    // Completion events for the transfer engine and the 3D engine
+    void on_transfer_done();
+    void on_draw_done();
+
+    // Waits until the GPU no longer reads any submitted source
+    bool wait_sources_released(int timeout_ms);
+    // Waits until the target (or every target when NULL) has no jobs left
+    bool wait_idle(const GpuJobTarget *target, int timeout_ms);
+    // Forgets all jobs, used when completion events were lost
+    void reset();
+
+  private:
+    void pump();
+    bool tex_in_use(const GpuJob &job) const;
+    bool fb_in_use(const GpuJob &job) const;
+    void start_tile(GpuJob &job);
+    void start_draw(GpuJob &job);
+    void start_present(GpuJob &job);
+
+  private:
+    size_t max_jobs;
+    // A list keeps job pointers valid while other jobs are removed
+    std::list<GpuJob> jobs;
+    GpuJob *transfer_job = nullptr;
+    GpuJob *draw_job = nullptr;
+    std::mutex mutex;
+    std::condition_variable progress_cond;
+};
@@ -17,6 +17,9 @@
  * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "FramePacer.hpp"
+#include "GpuJobQueue.hpp"
+
 #include <3ds.h>
 #include <Limelight.h>
 
@@ -26,24 +29,46 @@
 // offsets work
 #define MOON_CTR_VIDEO_TEX_H_OFFSET 32
 #define CMDLIST_SZ 0x800
+// Source textures per renderer, so one can be tiled while the other is drawn
+#define MOON_CTR_VIDEO_TEX_COUNT 2
+
+#define N3DS_TICKS_TO_US(ticks) ((u32)((ticks) * 1000000ULL / SYSCLOCK_ARM11))
 
-class N3dsRendererBase {
+class N3dsRendererBase : public GpuJobTarget {
   public:
     N3dsRendererBase(gfxScreen_t screen_in, int surface_width_in,
                      int surface_height_in, int image_width_in,
                      int image_height_in, int pixel_size,
-                     bool debug_in = false);
+                     bool debug_in = false, bool use_p3d = true);
     ~N3dsRendererBase();
+    // Queues the frame on the GPU and returns without waiting for it
     virtual void write_px_to_framebuffer(uint8_t *source) = 0;
-
-  public:
-    u64 perf_frame_target_ticks = SYSCLOCK_ARM11 * ((double)(1.0 / 60.0));
-    u64 perf_decode_ticks;
-    u64 perf_fbcopy_ticks;
+    // Blocks until the GPU no longer reads any submitted source buffer
+    void sync_source();
+    // Sleeps until the latest time a present can start and still make the
+    // next VBlank in reach, callers pick the newest frame once it returns
+    static void wait_for_present_slot();
+    // True while a renderer is listening for GPU completions
+    static bool gpu_queue_running();
+    // Queues a single transfer for something that isn't a renderer, in order
+    // with the video frames, without waiting. Returns false when no renderer
+    // is running or the queue is full. The target's finish is only called if
+    // the transfer completed, jobs are dropped when the queue is reset.
+    static bool queue_foreign_transfer(GpuJobTarget *target,
+                                       const void *source);
+    // True once the target has no transfer queued, a timeout of 0 only checks
+    static bool foreign_transfer_idle(const GpuJobTarget *target,
+                                      int timeout_ms);
 
   protected:
-    inline void draw_perf_counters();
+    void build_cmdlist();
     void write_px_to_framebuffer_gpu(uint8_t *__restrict source);
+    void submit_to_gpu(const void *source, int tex_index, bool present_only);
+    void start_tile(const GpuJob &job);
+    void start_draw(const GpuJob &job);
+    int present_transfer_count(const GpuJob &job);
+    void start_present(const GpuJob &job, int transfer);
+    void finish(const GpuJob &job);
     void ensure_3d_enabled();
     void ensure_3d_disabled();
     inline void write24(u8 *p, u32 val);
@@ -57,8 +82,13 @@ class N3dsRendererBase {
     int px_size;
     bool debug;
     u32 *cmdlist = NULL;
+    u32 cmdlist_len = 0;
+    u32 cmdlist_tex_addr_idx = 0;
     void *vramFb = NULL;
-    void *vramTex = NULL;
+    void *vramTex[MOON_CTR_VIDEO_TEX_COUNT] = {};
+    int next_tex = 0;
+    bool present_3d = false;
+    u64 submit_ticks[MOON_CTR_VIDEO_TEX_COUNT] = {};
 };
 
 class N3dsRendererTop : public N3dsRendererBase {
@@ -77,6 +107,28 @@ class N3dsRendererBottom : public N3dsRendererBase {
     void write_px_to_framebuffer(uint8_t *source);
 };
 
+// Presents a source that was already rotated and tiled by Y2R with a single
+// display transfer, letting the transfer engine do any 2x downscale instead of
+// a P3D pass. Only usable when the image is an exact 1x or 2x multiple of the
+// surface.
+class N3dsRendererDirect : public N3dsRendererBase {
+  public:
+    N3dsRendererDirect(gfxScreen_t screen_in, int dest_width, int dest_height,
+                       int src_width, int src_height, int px_size,
+                       bool debug_in = false);
+    ~N3dsRendererDirect();
+    static bool supports(int dest_width, int dest_height, int src_width,
+                         int src_height);
+    void write_px_to_framebuffer(uint8_t *source);
+
+  protected:
+    int present_transfer_count(const GpuJob &job);
+    void start_present(const GpuJob &job, int transfer);
+
+  private:
+    u32 transfer_scaling;
+};
+
 class N3dsRendererDualScreenStretch : public N3dsRendererBase {
   public:
     N3dsRendererDualScreenStretch(int dest_width, int dest_height,
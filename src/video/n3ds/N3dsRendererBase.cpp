@@ -20,30 +20,91 @@
 #include "N3dsRenderer.hpp"
 #include "vshader_shbin.h"
 
+#include "../../n3ds/perf_stats.hpp"
+
 #include <3ds.h>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <stdbool.h>
 #include <stdexcept>
 #include <unistd.h>
 
+// Frames in flight across all renderers
+#define N3DS_GPU_QUEUE_DEPTH 4
+// Completions stop arriving when GPU right is lost
+#define N3DS_GPU_TIMEOUT_MS 100
+
+// The panel refreshes at 268111856 / 4481136 Hz, about 59.83 Hz
+#define N3DS_VBLANK_PERIOD_TICKS (SYSCLOCK_ARM11 * 4481136ULL / 268111856ULL)
+
+static GpuJobQueue gpu_queue(N3DS_GPU_QUEUE_DEPTH);
+static FramePacer frame_pacer(N3DS_VBLANK_PERIOD_TICKS);
+// Renderers are created on the decode thread, the keyboard checks from input
+static std::atomic<int> gpu_queue_users(0);
+// Held while the callbacks are registered or removed, so a foreign transfer is
+// never queued without them
+static std::mutex gpu_queue_users_mutex;
+
+static void gpu_queue_on_ppf(void *) { gpu_queue.on_transfer_done(); }
+
+static void gpu_queue_on_p3d(void *) { gpu_queue.on_draw_done(); }
+
+static void frame_pacer_on_vblank(void *) {
+    frame_pacer.on_vblank(svcGetSystemTick());
+}
+
 N3dsRendererBase::N3dsRendererBase(gfxScreen_t screen_in, int surface_width_in,
                                    int surface_height_in, int image_width_in,
                                    int image_height_in, int pixel_size,
-                                   bool debug_in)
+                                   bool debug_in, bool use_p3d)
     : screen(screen_in), surface_width(surface_width_in),
       surface_height(surface_height_in), image_width(image_width_in),
       image_height(image_height_in), debug(debug_in), px_size(pixel_size) {
-    cmdlist = (u32 *)linearAlloc(CMDLIST_SZ * 4);
-    vramFb = vramAlloc(surface_width * surface_height * px_size);
-    // Needs to be able to hold an 800x480
-    vramTex = vramAlloc(MOON_CTR_VIDEO_TEX_W * MOON_CTR_VIDEO_TEX_H * px_size);
+    if (use_p3d) {
+        cmdlist = (u32 *)linearAlloc(CMDLIST_SZ * 4);
+        vramFb = vramAlloc(surface_width * surface_height * px_size);
+        build_cmdlist();
+    }
+
+    std::lock_guard<std::mutex> lock(gpu_queue_users_mutex);
+    if (gpu_queue_users++ == 0) {
+        gspSetEventCallback(GSPGPU_EVENT_PPF, gpu_queue_on_ppf, NULL, false);
+        gspSetEventCallback(GSPGPU_EVENT_P3D, gpu_queue_on_p3d, NULL, false);
+        gspSetEventCallback(GSPGPU_EVENT_VBlank0, frame_pacer_on_vblank, NULL,
+                            false);
+    }
 }
 
 N3dsRendererBase::~N3dsRendererBase() {
-    linearFree(cmdlist);
-    vramFree(vramFb);
-    vramFree(vramTex);
+    if (!gpu_queue.wait_idle(this, N3DS_GPU_TIMEOUT_MS)) {
+        gpu_queue.reset();
+    }
+    {
+        std::lock_guard<std::mutex> lock(gpu_queue_users_mutex);
+        if (--gpu_queue_users == 0) {
+            // Foreign transfers can't complete once the callbacks are gone
+            if (!gpu_queue.wait_idle(NULL, N3DS_GPU_TIMEOUT_MS)) {
+                gpu_queue.reset();
+            }
+            gspSetEventCallback(GSPGPU_EVENT_PPF, NULL, NULL, false);
+            gspSetEventCallback(GSPGPU_EVENT_P3D, NULL, NULL, false);
+            gspSetEventCallback(GSPGPU_EVENT_VBlank0, NULL, NULL, false);
+        }
+    }
+
+    if (cmdlist) {
+        linearFree(cmdlist);
+    }
+    if (vramFb) {
+        vramFree(vramFb);
+    }
+    for (int i = 0; i < MOON_CTR_VIDEO_TEX_COUNT; i++) {
+        if (vramTex[i]) {
+            vramFree(vramTex[i]);
+        }
+    }
 
     // Clear both screens
     u8 *top = gfxGetFramebuffer(GFX_TOP, GFX_LEFT, NULL, NULL);
@@ -63,6 +124,37 @@ N3dsRendererBase::~N3dsRendererBase() {
     printf("Closing stream...");
 }
 
+void N3dsRendererBase::sync_source() {
+    if (!gpu_queue.wait_sources_released(N3DS_GPU_TIMEOUT_MS)) {
+        gpu_queue.reset();
+    }
+}
+
+void N3dsRendererBase::wait_for_present_slot() {
+    u64 now = svcGetSystemTick();
+    u64 deadline = frame_pacer.present_deadline(now);
+    if (perf_stats_enabled()) {
+        perf_stats_set_counter(PERF_COUNTER_LATE, frame_pacer.late());
+    }
+    if (deadline > now) {
+        svcSleepThread((deadline - now) * 1000000000ULL / SYSCLOCK_ARM11);
+    }
+}
+
+bool N3dsRendererBase::gpu_queue_running() { return gpu_queue_users > 0; }
+
+bool N3dsRendererBase::queue_foreign_transfer(GpuJobTarget *target,
+                                              const void *source) {
+    // Never waits for room, the queue is only reset by the renderers
+    std::lock_guard<std::mutex> lock(gpu_queue_users_mutex);
+    return gpu_queue_users > 0 && gpu_queue.submit(target, source, 0, 0, true);
+}
+
+bool N3dsRendererBase::foreign_transfer_idle(const GpuJobTarget *target,
+                                             int timeout_ms) {
+    return gpu_queue.wait_idle(target, timeout_ms);
+}
+
 void N3dsRendererBase::ensure_3d_enabled() {
     if (!gfxIs3D()) {
         gfxSetWide(false);
@@ -85,38 +177,6 @@ inline void N3dsRendererBase::write24(u8 *p, u32 val) {
     p[2] = val >> 16;
 }
 
-inline void N3dsRendererBase::draw_perf_counters() {
-    u8 *dest = gfxGetFramebuffer(screen, GFX_LEFT, NULL, NULL);
-
-    // Use a line going across the first scanline (left) for the perf counters.
-    // Clear to black
-    memset(dest, 0, GSP_SCREEN_WIDTH * 3);
-
-    // Display frame target in the middle of the screen.
-    double perf_tick_divisor =
-        ((double)GSP_SCREEN_WIDTH) / ((double)(perf_frame_target_ticks * 2));
-    u32 perf_px = 0;
-    u32 perf_tmp_height = 0;
-
-#define PERF_DRAW(ticks, r, g, b)                                              \
-    perf_tmp_height = perf_tick_divisor * ((double)(ticks));                   \
-    do {                                                                       \
-        if (perf_px > GSP_SCREEN_WIDTH)                                        \
-            break;                                                             \
-        const u32 color = (r << 16) | (g << 8) | b;                            \
-        memcpy(dest + (perf_px * 3), &color, 3);                               \
-        perf_px++;                                                             \
-    } while (perf_tmp_height-- > 0);
-
-    PERF_DRAW(perf_decode_ticks, 255, 0, 0);
-    PERF_DRAW(perf_fbcopy_ticks, 0, 0, 255);
-
-    // Draw two green pixels at the center
-    perf_px = (GSP_SCREEN_WIDTH / 2) - 1;
-    PERF_DRAW(0, 0, 255, 0);
-    PERF_DRAW(0, 0, 255, 0);
-}
-
 void N3dsRendererBase::write_px_to_framebuffer_gpu(uint8_t *__restrict source) {
     // Do nothing when GPU right is lost, otherwise we hang when going to
     // the home menu.
@@ -124,28 +184,58 @@ void N3dsRendererBase::write_px_to_framebuffer_gpu(uint8_t *__restrict source) {
         return;
     }
 
-    u64 start_ticks = svcGetSystemTick();
+    // Textures are allocated on first use, renderers that only forward to
+    // other renderers never need them. Needs to be able to hold an 800x480.
+    int tex_index = next_tex;
+    if (!vramTex[tex_index]) {
+        vramTex[tex_index] =
+            vramAlloc(MOON_CTR_VIDEO_TEX_W * MOON_CTR_VIDEO_TEX_H * px_size);
+    }
+    if (!vramTex[tex_index]) {
+        // Not enough VRAM to double buffer, reuse the first texture
+        tex_index = 0;
+        if (!vramTex[tex_index]) {
+            return;
+        }
+    }
+    next_tex = (tex_index + 1) % MOON_CTR_VIDEO_TEX_COUNT;
+
+    submit_ticks[tex_index] = svcGetSystemTick();
+    submit_to_gpu(source, tex_index, false);
+}
 
+void N3dsRendererBase::submit_to_gpu(const void *source, int tex_index,
+                                     bool present_only) {
+    if (!gpu_queue.submit(this, source, tex_index, N3DS_GPU_TIMEOUT_MS,
+                          present_only)) {
+        // Completions were lost, start over with an empty queue
+        gpu_queue.reset();
+    }
+}
+
+void N3dsRendererBase::start_tile(const GpuJob &job) {
     // NOTE: At 800x480, we can display the _width_ natively, but the height
     // needs to be downsampled. MVD is incapable of downsampling, so we have to
     // do it on the GPU.
 
-    // TODO: If we can use rotation from the decoder, we can do a 2x downscale
-    // using display transfer and skip P3D. Not necessary because PICA is
-    // significantly faster than the decoder.
+    // When the decoder output can be rotated (Y2R), N3dsRendererDirect does
+    // the 2x downscale with a display transfer and skips P3D instead.
 
     // Tile the source image into the scratch buffer.
     GX_DisplayTransfer(
-        (u32 *)source,
+        (u32 *)job.source,
         GX_BUFFER_DIM(MOON_CTR_VIDEO_TEX_W, MOON_CTR_VIDEO_TEX_H),
-        (u32 *)vramTex,
+        (u32 *)vramTex[job.tex_index],
         GX_BUFFER_DIM(MOON_CTR_VIDEO_TEX_W, MOON_CTR_VIDEO_TEX_H),
         GX_TRANSFER_FLIP_VERT(1) | GX_TRANSFER_OUT_TILED(1) |
             GX_TRANSFER_IN_FORMAT(GX_TRANSFER_FMT_RGB565) |
             GX_TRANSFER_OUT_FORMAT(GX_TRANSFER_FMT_RGB565));
+}
 
-    // While the transfer is running, create a temporary command list to rotate
-    // the framebuffer into source
+// Only the texture address changes between frames, so the command list is
+// built once and that word is patched before each draw.
+void N3dsRendererBase::build_cmdlist() {
+    // Create a command list to rotate the tiled texture into the framebuffer
     GPUCMD_SetBuffer(cmdlist, CMDLIST_SZ, 0);
 
     // TODO: Verify this mitigates rounding errors due to f24 precision issues.
@@ -193,7 +283,10 @@ void N3dsRendererBase::write_px_to_framebuffer_gpu(uint8_t *__restrict source) {
     // Texturing
     C(GPUREG_TEXUNIT0_TYPE, GPU_RGB565);
     C(GPUREG_TEXUNIT0_DIM, MOON_CTR_VIDEO_TEX_H | (MOON_CTR_VIDEO_TEX_W << 16));
-    C(GPUREG_TEXUNIT0_ADDR1, osConvertVirtToPhys(vramTex) >> 3);
+    u32 *unused;
+    u32 unused_size;
+    GPUCMD_GetBuffer(&unused, &unused_size, &cmdlist_tex_addr_idx);
+    C(GPUREG_TEXUNIT0_ADDR1, 0); // Patched in start_draw
     C(GPUREG_TEXUNIT0_PARAM,
       GPU_NEAREST | (GPU_LINEAR << 1)); // Linear min and mag filter
 
@@ -322,44 +415,39 @@ void N3dsRendererBase::write_px_to_framebuffer_gpu(uint8_t *__restrict source) {
 
 #undef C
 
-    gspWaitForEvent(GSPGPU_EVENT_PPF, 0);
-
-    u32 *unused;
-    u32 cmdlist_len;
     GPUCMD_Split(&unused, &cmdlist_len);
-    GSPGPU_FlushDataCache(cmdlist, cmdlist_len);
+}
+
+void N3dsRendererBase::start_draw(const GpuJob &job) {
+    // The 3D engine is idle here, so the command list is free to patch.
+    // Parameter words come before their command header.
+    cmdlist[cmdlist_tex_addr_idx] =
+        osConvertVirtToPhys(vramTex[job.tex_index]) >> 3;
 
-    extern u32 __ctru_linear_heap;
-    extern u32 __ctru_linear_heap_size;
-    GX_FlushCacheRegions(cmdlist, cmdlist_len * 4, (u32 *)__ctru_linear_heap,
-                         __ctru_linear_heap_size, NULL, 0);
+    // Nothing else in the linear heap is written by the CPU for this draw
+    GX_FlushCacheRegions(cmdlist, cmdlist_len * 4, NULL, 0, NULL, 0);
 
     GX_ProcessCommandList(cmdlist, cmdlist_len * 4, 2);
+}
 
-    gspWaitForEvent(GSPGPU_EVENT_P3D, 0);
+int N3dsRendererBase::present_transfer_count(const GpuJob &job) {
+    present_3d = (screen == GFX_TOP) && gfxIs3D();
+    return present_3d ? 2 : 1;
+}
 
+void N3dsRendererBase::start_present(const GpuJob &job, int transfer) {
     // Copy into framebuffer, untiled
-    if ((screen == GFX_TOP) && gfxIs3D()) {
-        // Left
-        u32 *dest_left =
-            (u32 *)gfxGetFramebuffer(GFX_TOP, GFX_LEFT, NULL, NULL);
+    if (present_3d) {
+        // Left, then right
+        gfx3dSide_t side = transfer == 0 ? GFX_LEFT : GFX_RIGHT;
+        u32 *dest = (u32 *)gfxGetFramebuffer(GFX_TOP, side, NULL, NULL);
         auto surface_width_3d = surface_width / 2;
-        GX_DisplayTransfer(
-            (u32 *)vramFb, GX_BUFFER_DIM(surface_height, surface_width_3d),
-            dest_left, GX_BUFFER_DIM(surface_height, surface_width_3d),
-            GX_TRANSFER_OUT_TILED(0) |
-                GX_TRANSFER_IN_FORMAT(GX_TRANSFER_FMT_RGB565) |
-                GX_TRANSFER_OUT_FORMAT(GX_TRANSFER_FMT_RGB565) |
-                GX_TRANSFER_SCALING(GX_TRANSFER_SCALE_NO));
-
-        // Right
-        u32 *dest_right =
-            (u32 *)gfxGetFramebuffer(GFX_TOP, GFX_RIGHT, NULL, NULL);
         auto surface_offset_3d =
-            surface_height * surface_width * px_size / (sizeof(u32) * 2);
+            transfer * surface_height * surface_width * px_size /
+            (sizeof(u32) * 2);
         GX_DisplayTransfer((u32 *)vramFb + surface_offset_3d,
                            GX_BUFFER_DIM(surface_height, surface_width_3d),
-                           dest_right,
+                           dest,
                            GX_BUFFER_DIM(surface_height, surface_width_3d),
                            GX_TRANSFER_OUT_TILED(0) |
                                GX_TRANSFER_IN_FORMAT(GX_TRANSFER_FMT_RGB565) |
@@ -375,11 +463,18 @@ void N3dsRendererBase::write_px_to_framebuffer_gpu(uint8_t *__restrict source) {
                                GX_TRANSFER_OUT_FORMAT(GX_TRANSFER_FMT_RGB565) |
                                GX_TRANSFER_SCALING(GX_TRANSFER_SCALE_NO));
     }
-    gspWaitForEvent(GSPGPU_EVENT_PPF, 0);
+}
 
-    perf_fbcopy_ticks = svcGetSystemTick() - start_ticks;
-    if (debug) {
-        draw_perf_counters();
+void N3dsRendererBase::finish(const GpuJob &job) {
+    u64 now = svcGetSystemTick();
+    u64 present_ticks = now - submit_ticks[job.tex_index];
+    frame_pacer.on_present_cost(present_ticks);
+    if (perf_stats_enabled()) {
+        perf_stats_push(PERF_STAT_PRESENT, N3DS_TICKS_TO_US(present_ticks));
+        perf_stats_push(PERF_STAT_VBLANK_OFFSET,
+                        N3DS_TICKS_TO_US(frame_pacer.ticks_until_vblank(now)));
+        perf_stats_set_counter(PERF_COUNTER_FRAME_PERIOD,
+                               N3DS_TICKS_TO_US(frame_pacer.period()));
     }
 
     gfxScreenSwapBuffers(screen, true);
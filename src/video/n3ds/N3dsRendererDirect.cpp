@@ -0,0 +1,103 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "N3dsRenderer.hpp"
+
+#include <3ds.h>
+
+// The source is rotated to the framebuffer's column-major layout, so its
+// rows run along the screen width and its columns along the 240px height.
+// The transfer engine's X axis therefore downscales the image height.
+static int get_transfer_scaling(int dest_width, int dest_height, int src_width,
+                                int src_height) {
+    bool width_1x = src_width == dest_width;
+    bool width_2x = src_width == dest_width * 2;
+    bool height_1x = src_height == dest_height;
+    bool height_2x = src_height == dest_height * 2;
+
+    if (width_1x && height_1x) {
+        return GX_TRANSFER_SCALE_NO;
+    } else if (width_1x && height_2x) {
+        return GX_TRANSFER_SCALE_X;
+    } else if (width_2x && height_2x) {
+        return GX_TRANSFER_SCALE_XY;
+    }
+    return -1;
+}
+
+N3dsRendererDirect::N3dsRendererDirect(gfxScreen_t screen_in, int dest_width,
+                                       int dest_height, int src_width,
+                                       int src_height, int px_size,
+                                       bool debug_in)
+    : N3dsRendererBase(screen_in, dest_width, dest_height, src_width,
+                       src_height, px_size, debug_in, false),
+      transfer_scaling(get_transfer_scaling(dest_width, dest_height,
+                                            src_width, src_height)) {}
+
+N3dsRendererDirect::~N3dsRendererDirect() = default;
+
+bool N3dsRendererDirect::supports(int dest_width, int dest_height,
+                                  int src_width, int src_height) {
+    return get_transfer_scaling(dest_width, dest_height, src_width,
+                                src_height) >= 0;
+}
+
+void N3dsRendererDirect::write_px_to_framebuffer(uint8_t *source) {
+    if (!gspHasGpuRight()) {
+        return;
+    }
+
+    if (screen == GFX_TOP) {
+        if (osGet3DSliderState() > 0.0 &&
+            surface_width >= GSP_SCREEN_HEIGHT_TOP_2X) {
+            ensure_3d_enabled();
+        } else {
+            ensure_3d_disabled();
+        }
+    }
+
+    submit_ticks[0] = svcGetSystemTick();
+    submit_to_gpu(source, 0, true);
+}
+
+int N3dsRendererDirect::present_transfer_count(const GpuJob &job) {
+    present_3d = (screen == GFX_TOP) && gfxIs3D();
+    return present_3d ? 2 : 1;
+}
+
+void N3dsRendererDirect::start_present(const GpuJob &job, int transfer) {
+    int src_rows = image_width;
+    int dest_rows = surface_width;
+    gfx3dSide_t side = GFX_LEFT;
+    u8 *source = (u8 *)job.source;
+
+    // Each eye shows one half of the image, i.e. half of the source rows
+    if (present_3d) {
+        src_rows /= 2;
+        dest_rows /= 2;
+        side = transfer == 0 ? GFX_LEFT : GFX_RIGHT;
+        source += transfer * src_rows * image_height * px_size;
+    }
+
+    u32 *dest = (u32 *)gfxGetFramebuffer(screen, side, NULL, NULL);
+    GX_DisplayTransfer((u32 *)source, GX_BUFFER_DIM(image_height, src_rows),
+                       dest, GX_BUFFER_DIM(surface_height, dest_rows),
+                       GX_TRANSFER_OUT_TILED(0) |
+                           GX_TRANSFER_IN_FORMAT(GX_TRANSFER_FMT_RGB565) |
+                           GX_TRANSFER_OUT_FORMAT(GX_TRANSFER_FMT_RGB565) |
+                           GX_TRANSFER_SCALING(transfer_scaling));
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "N3dsY2rEngine.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+
+// Upper bound for the previous conversion when starting a new one
+#define Y2R_START_TIMEOUT_NS 20000000
+
+N3dsY2rEngine::N3dsY2rEngine(const Y2RU_ConversionParams &params_in,
+                             int px_size_in, int dest_stride_in)
+    : params(params_in), px_size(px_size_in), dest_stride(dest_stride_in) {
+    if (y2rInit()) {
+        throw std::runtime_error("Failed to initialize Y2R\n");
+    }
+    if (Y2RU_SetConversionParams(&params)) {
+        y2rExit();
+        throw std::runtime_error("Failed to set Y2RU params\n");
+    }
+    if (Y2RU_SetTransferEndInterrupt(true) ||
+        Y2RU_GetTransferEndEvent(&end_event)) {
+        y2rExit();
+        throw std::runtime_error("Y2RU_GetTransferEndEvent failed\n");
+    }
+}
+
+N3dsY2rEngine::~N3dsY2rEngine() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        settled_cond.wait(lock, [&] { return !event_waiting; });
+        if (active_job && active_job->state == Y2R_JOB_PENDING) {
+            Y2RU_StopConversion();
+            active_job->state = Y2R_JOB_DROPPED;
+        }
+    }
+    svcCloseHandle(end_event);
+    y2rExit();
+}
+
+bool N3dsY2rEngine::wait_locked(std::unique_lock<std::mutex> &lock,
+                                Y2rJob *job, s64 timeout_ns) {
+    while (job->state == Y2R_JOB_PENDING) {
+        if (event_waiting) {
+            // Another thread is waiting on the event within its own timeout
+            settled_cond.wait(lock);
+            continue;
+        }
+
+        // Only the active conversion can be pending. The mutex is released
+        // so the other thread is not held up behind this wait.
+        event_waiting = true;
+        lock.unlock();
+        Result status = svcWaitSynchronization(end_event, timeout_ns);
+        lock.lock();
+        event_waiting = false;
+
+        if (status == 0) {
+            active_job->state = Y2R_JOB_DONE;
+            last_convert_ticks = svcGetSystemTick() - start_ticks;
+        } else {
+            Y2RU_StopConversion();
+            svcClearEvent(end_event);
+            active_job->state = Y2R_JOB_DROPPED;
+            frames_dropped++;
+        }
+        settled_cond.notify_all();
+    }
+    return job->state == Y2R_JOB_DONE;
+}
+
+bool N3dsY2rEngine::wait(Y2rJob *job, s64 timeout_ns) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return wait_locked(lock, job, timeout_ns);
+}
+
+bool N3dsY2rEngine::start(const u8 *const *planes, u8 *dest, Y2rJob *job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (active_job) {
+        wait_locked(lock, active_job, Y2R_START_TIMEOUT_NS);
+    }
+    job->state = Y2R_JOB_IDLE;
+
+    int width = params.input_line_width;
+    int height = params.input_lines;
+
+    if (Y2RU_SetSendingY(planes[0], width * height, width, 0)) {
+        fprintf(stderr, "Y2RU_SetSendingY failed\n");
+        return false;
+    }
+    if (Y2RU_SetSendingU(planes[1], width * height / 4, width / 2, 0)) {
+        fprintf(stderr, "Y2RU_SetSendingU failed\n");
+        return false;
+    }
+    if (Y2RU_SetSendingV(planes[2], width * height / 4, width / 2, 0)) {
+        fprintf(stderr, "Y2RU_SetSendingV failed\n");
+        return false;
+    }
+
+    int status;
+    if (params.block_alignment == BLOCK_8_BY_8) {
+        // Tightly packed 8x8 blocks, received eight lines at a time
+        status = Y2RU_SetReceiving(dest, width * height * px_size,
+                                   width * 8 * px_size, 0);
+    } else {
+        status = Y2RU_SetReceiving(dest, dest_stride * height * px_size,
+                                   width * px_size,
+                                   (dest_stride - width) * px_size);
+    }
+    if (status) {
+        fprintf(stderr, "Y2RU_SetReceiving failed\n");
+        return false;
+    }
+
+    start_ticks = svcGetSystemTick();
+    if (Y2RU_StartConversion()) {
+        fprintf(stderr, "Y2RU_StartConversion failed\n");
+        return false;
+    }
+
+    job->state = Y2R_JOB_PENDING;
+    active_job = job;
+    return true;
+}
+
+u64 N3dsY2rEngine::dropped() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames_dropped;
+}
+
+u64 N3dsY2rEngine::convert_ticks() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return last_convert_ticks;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <3ds.h>
+
+#include <condition_variable>
+#include <mutex>
+
+enum Y2rJobState { Y2R_JOB_IDLE, Y2R_JOB_PENDING, Y2R_JOB_DONE, Y2R_JOB_DROPPED };
+
+// Conversion state for one destination buffer. The caller owns it and keeps
+// it with the buffer, so the outcome of a conversion stays known however many
+// conversions were started after it.
+struct Y2rJob {
+    Y2rJobState state = Y2R_JOB_IDLE;
+};
+
+// Asynchronous YUV to RGB conversion on the Y2R unit. Conversion parameters
+// are applied once and the transfer end event is kept open, so each frame only
+// sets the buffer addresses and starts. start() returns right away, letting
+// the caller do other work while the conversion runs and wait on the job later.
+class N3dsY2rEngine {
+  public:
+    // dest_stride is the output line length in pixels for line output, it is
+    // ignored for 8x8 block output which is always tightly packed
+    N3dsY2rEngine(const Y2RU_ConversionParams &params_in, int px_size_in,
+                  int dest_stride_in);
+    ~N3dsY2rEngine();
+
+    // Starts converting the three planes into dest, after the previous
+    // conversion finished. Returns false if the conversion could not be
+    // started, job is left idle in that case.
+    bool start(const u8 *const *planes, u8 *dest, Y2rJob *job);
+
+    // Returns true once the conversion for job has completed. A conversion
+    // that does not finish within timeout_ns is stopped and counted as
+    // dropped, its output must not be presented.
+    bool wait(Y2rJob *job, s64 timeout_ns);
+
+    u64 dropped();
+
+    // Ticks from the start of the last completed conversion to it being seen
+    // as complete, an upper bound on how long it took
+    u64 convert_ticks();
+
+  private:
+    bool wait_locked(std::unique_lock<std::mutex> &lock, Y2rJob *job,
+                     s64 timeout_ns);
+
+  private:
+    Y2RU_ConversionParams params;
+    int px_size;
+    int dest_stride;
+    Handle end_event = 0;
+    Y2rJob *active_job = nullptr;
+    // Set while a thread waits on end_event with the mutex released, other
+    // waiters wait for it to settle the active job
+    bool event_waiting = false;
+    u64 frames_dropped = 0;
+    u64 start_ticks = 0;
+    u64 last_convert_ticks = 0;
+    std::mutex mutex;
+    std::condition_variable settled_cond;
+};
@@ -0,0 +1,180 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Yuv420ToRgb565.hpp"
+
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#define YUV_HAVE_SIMD32
+#elif defined(YUV_EMULATE_SIMD32)
+// Host tests run the SIMD kernel on C versions of the intrinsics
+#include "arm_acle_emu.h"
+#define YUV_HAVE_SIMD32
+#endif
+
+// BT.709 limited range coefficients in Q5. Small enough that every
+// intermediate fits a signed halfword, and precise enough for 5/6 bit output.
+#define YUV_COEF_Y 37   // 1.164
+#define YUV_COEF_RV 57  // 1.793
+#define YUV_COEF_GU -7  // -0.213
+#define YUV_COEF_GV -17 // -0.533
+#define YUV_COEF_BU 68  // 2.112
+
+// Clamping (x >> 5) to 0..255 and then dropping to 5 or 6 bits is the same as
+// clamping x >> 8 or x >> 7 directly, which maps onto a single USAT.
+static inline int clamp_bits(int x, int max) {
+    return x < 0 ? 0 : (x > max ? max : x);
+}
+
+static inline uint16_t pack_rgb565(int y, int rv, int guv, int bu) {
+    int r = clamp_bits((y + rv) >> 8, 31);
+    int g = clamp_bits((y + guv) >> 7, 63);
+    int b = clamp_bits((y + bu) >> 8, 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// Converts columns [x_start, width) of one row pair, rows_left is 1 for a
+// trailing odd row.
+static void convert_rows_scalar(const uint8_t *y0, const uint8_t *y1,
+                                const uint8_t *u, const uint8_t *v,
+                                int x_start, int width, uint16_t *d0,
+                                uint16_t *d1, int rows_left) {
+    for (int x = x_start; x < width; x++) {
+        int cu = u[x / 2] - 128;
+        int cv = v[x / 2] - 128;
+        int rv = YUV_COEF_RV * cv;
+        int guv = YUV_COEF_GU * cu + YUV_COEF_GV * cv;
+        int bu = YUV_COEF_BU * cu;
+
+        d0[x] = pack_rgb565(YUV_COEF_Y * (y0[x] - 16), rv, guv, bu);
+        if (rows_left > 1) {
+            d1[x] = pack_rgb565(YUV_COEF_Y * (y1[x] - 16), rv, guv, bu);
+        }
+    }
+}
+
+void yuv420_to_rgb565_reference(const uint8_t *const planes[3],
+                                const int strides[3], int width, int height,
+                                uint16_t *dest, int dest_stride) {
+    for (int row = 0; row < height; row += 2) {
+        convert_rows_scalar(planes[0] + row * strides[0],
+                            planes[0] + (row + 1) * strides[0],
+                            planes[1] + (row / 2) * strides[1],
+                            planes[2] + (row / 2) * strides[2], 0, width,
+                            dest + row * dest_stride,
+                            dest + (row + 1) * dest_stride, height - row);
+    }
+}
+
+#if defined(YUV_HAVE_SIMD32)
+
+#define YUV_PACK16(lo, hi) ((uint32_t)(uint16_t)(lo) | ((uint32_t)(hi) << 16))
+
+static inline uint32_t pack_rgb565_simd(int32_t y, int32_t rv, int32_t guv,
+                                        int32_t bu) {
+    uint32_t r = __usat((y + rv) >> 8, 5);
+    uint32_t g = __usat((y + guv) >> 7, 6);
+    uint32_t b = __usat((y + bu) >> 8, 5);
+    return (r << 11) | (g << 5) | b;
+}
+
+// Four pixels across two rows per step. UXTB16 splits four luma bytes into
+// even/odd halfword pairs, SSUB16 removes the offsets two lanes at a time and
+// SMUAD evaluates each chroma term for a (U, V) halfword pair in one go.
+static int convert_rows_simd(const uint8_t *y0, const uint8_t *y1,
+                             const uint8_t *u, const uint8_t *v, int width,
+                             uint16_t *d0, uint16_t *d1, int rows_left) {
+    const uint32_t coef_r = YUV_PACK16(0, YUV_COEF_RV);
+    const uint32_t coef_g = YUV_PACK16(YUV_COEF_GU, YUV_COEF_GV);
+    const uint32_t coef_b = YUV_PACK16(YUV_COEF_BU, 0);
+    const uint32_t luma_bias = YUV_PACK16(16, 16);
+    const uint32_t chroma_bias = YUV_PACK16(128, 128);
+
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        int32_t uv[2];
+        for (int i = 0; i < 2; i++) {
+            uint32_t packed = YUV_PACK16(u[x / 2 + i], v[x / 2 + i]);
+            uv[i] = __ssub16(packed, chroma_bias);
+        }
+        int32_t rv[2], guv[2], bu[2];
+        for (int i = 0; i < 2; i++) {
+            rv[i] = __smuad(uv[i], coef_r);
+            guv[i] = __smuad(uv[i], coef_g);
+            bu[i] = __smuad(uv[i], coef_b);
+        }
+
+        for (int row = 0; row < rows_left && row < 2; row++) {
+            const uint8_t *src = row == 0 ? y0 : y1;
+            uint16_t *dst = row == 0 ? d0 : d1;
+
+            uint32_t luma = src[x] | (src[x + 1] << 8) | (src[x + 2] << 16) |
+                            ((uint32_t)src[x + 3] << 24);
+            // (Y0, Y2) and (Y1, Y3) as signed halfwords
+            int32_t even = __ssub16(__uxtb16(luma), luma_bias);
+            int32_t odd = __ssub16(__uxtb16(luma >> 8), luma_bias);
+
+            int32_t ys[4] = {
+                YUV_COEF_Y * (int16_t)even,
+                YUV_COEF_Y * (int16_t)odd,
+                YUV_COEF_Y * (int16_t)(even >> 16),
+                YUV_COEF_Y * (int16_t)(odd >> 16),
+            };
+
+            uint32_t *out = (uint32_t *)(dst + x);
+            uint32_t p0 = pack_rgb565_simd(ys[0], rv[0], guv[0], bu[0]);
+            uint32_t p1 = pack_rgb565_simd(ys[1], rv[0], guv[0], bu[0]);
+            uint32_t p2 = pack_rgb565_simd(ys[2], rv[1], guv[1], bu[1]);
+            uint32_t p3 = pack_rgb565_simd(ys[3], rv[1], guv[1], bu[1]);
+            if (((uintptr_t)out & 3) == 0) {
+                out[0] = p0 | (p1 << 16);
+                out[1] = p2 | (p3 << 16);
+            } else {
+                dst[x] = p0;
+                dst[x + 1] = p1;
+                dst[x + 2] = p2;
+                dst[x + 3] = p3;
+            }
+        }
+    }
+    return x;
+}
+
+void yuv420_to_rgb565(const uint8_t *const planes[3], const int strides[3],
+                      int width, int height, uint16_t *dest, int dest_stride) {
+    for (int row = 0; row < height; row += 2) {
+        const uint8_t *y0 = planes[0] + row * strides[0];
+        const uint8_t *y1 = planes[0] + (row + 1) * strides[0];
+        const uint8_t *u = planes[1] + (row / 2) * strides[1];
+        const uint8_t *v = planes[2] + (row / 2) * strides[2];
+        uint16_t *d0 = dest + row * dest_stride;
+        uint16_t *d1 = dest + (row + 1) * dest_stride;
+
+        int done = convert_rows_simd(y0, y1, u, v, width, d0, d1, height - row);
+        convert_rows_scalar(y0, y1, u, v, done, width, d0, d1, height - row);
+    }
+}
+
+#else
+
+void yuv420_to_rgb565(const uint8_t *const planes[3], const int strides[3],
+                      int width, int height, uint16_t *dest, int dest_stride) {
+    yuv420_to_rgb565_reference(planes, strides, width, height, dest,
+                               dest_stride);
+}
+
+#endif
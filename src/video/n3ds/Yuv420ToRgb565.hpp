@@ -0,0 +1,36 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Platform independent so the SIMD kernel can be checked against the scalar
+// reference and benchmarked on the host.
+
+#include <cstdint>
+
+// CPU fallback for when Y2R can't be used. Converts planar YUV 4:2:0 (BT.709,
+// limited range) to RGB565, writing width x height pixels into dest with a
+// dest_stride (in pixels) between rows, i.e. the 1024x512 layout the renderers
+// tile from. Odd widths and heights are supported.
+//
+// Both versions produce bit-identical output. yuv420_to_rgb565 uses the ARMv6
+// SIMD instructions when built for a core that has them.
+void yuv420_to_rgb565(const uint8_t *const planes[3], const int strides[3],
+                      int width, int height, uint16_t *dest, int dest_stride);
+void yuv420_to_rgb565_reference(const uint8_t *const planes[3],
+                                const int strides[3], int width, int height,
+                                uint16_t *dest, int dest_stride);
@@ -18,9 +18,14 @@
  */
 
 #include "ffmpeg.h"
+#include "n3ds/FrameRing.hpp"
 #include "n3ds/N3dsRenderer.hpp"
+#include "n3ds/N3dsY2rEngine.hpp"
+#include "n3ds/Yuv420ToRgb565.hpp"
 #include "video.h"
 
+#include "../n3ds/n3ds_thread.hpp"
+#include "../n3ds/perf_stats.hpp"
 #include "../util.h"
 
 #include <3ds.h>
@@ -30,15 +35,34 @@
 
 #define SLICES_PER_FRAME 1
 #define N3DS_BUFFER_FRAMES 1
+// One slot being decoded into, one being presented and one waiting
+#define N3DS_FRAME_RING_SLOTS 3
+// A conversion normally takes a few ms, anything past this is dropped
+#define N3DS_Y2R_TIMEOUT_NS 10000000
 
 static void *ffmpeg_buffer;
 static size_t ffmpeg_buffer_size;
 static int image_width, image_height, surface_width, surface_height, pixel_size;
-static u8 *rgb_img_buffer;
+static bool direct_render = false;
 
 static std::unique_ptr<N3dsRendererBase> renderer = nullptr;
+static std::unique_ptr<N3dsY2rEngine> y2r_engine = nullptr;
 enum n3ds_render_type N3DS_RENDER_TYPE = RENDER_DEFAULT;
 
+// A decoded frame, kept referenced until Y2R has converted it into rgb
+struct ConvertedFrame {
+    AVFrame *frame;
+    u8 *rgb;
+    Y2rJob job;
+};
+
+// Frames handed from the decode/convert stage (receive thread) to the
+// present stage
+static std::unique_ptr<FrameRing<ConvertedFrame>> frame_ring = nullptr;
+static Thread present_thread = NULL;
+
+static void present_thread_main(void *arg);
+
 static int n3ds_setup(int videoFormat, int width, int height, int redrawRate,
                       void *context, int drFlags) {
     if (ffmpeg_init(videoFormat, width, height, 0, N3DS_BUFFER_FRAMES,
@@ -50,25 +74,6 @@ static int n3ds_setup(int videoFormat, int width, int height, int redrawRate,
     ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size,
                     INITIAL_DECODER_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
 
-    if (y2rInit()) {
-        fprintf(stderr, "Failed to initialize Y2R\n");
-        return -1;
-    }
-    Y2RU_ConversionParams y2r_parameters;
-    y2r_parameters.input_format = INPUT_YUV420_INDIV_8;
-    y2r_parameters.output_format = OUTPUT_RGB_16_565;
-    y2r_parameters.rotation = ROTATION_NONE;
-    y2r_parameters.block_alignment = BLOCK_LINE;
-    y2r_parameters.input_line_width = width;
-    y2r_parameters.input_lines = height;
-    y2r_parameters.standard_coefficient = COEFFICIENT_ITU_R_BT_709_SCALING;
-    y2r_parameters.alpha = 0xFF;
-    int status = Y2RU_SetConversionParams(&y2r_parameters);
-    if (status) {
-        fprintf(stderr, "Failed to set Y2RU params\n");
-        return -1;
-    }
-
     surface_height = GSP_SCREEN_WIDTH;
     if (width > GSP_SCREEN_HEIGHT_TOP) {
         surface_width = GSP_SCREEN_HEIGHT_TOP_2X;
@@ -80,15 +85,63 @@ static int n3ds_setup(int videoFormat, int width, int height, int redrawRate,
     image_width = width;
     image_height = height;
     pixel_size = gspGetBytesPerPixel(px_fmt);
-    rgb_img_buffer = (u8 *)linearAlloc(MOON_CTR_VIDEO_TEX_W *
-                                       MOON_CTR_VIDEO_TEX_H * pixel_size);
-    if (!rgb_img_buffer) {
-        fprintf(stderr, "Out of memory!\n");
-        return -1;
+
+    // Y2R needs a line width that is a multiple of 8, anything else is
+    // converted on the CPU
+    bool use_y2r = (width % 8) == 0 && width <= MOON_CTR_VIDEO_TEX_W;
+
+    // Skip the P3D pass when a display transfer can do the scaling, this
+    // needs the rotated output only Y2R produces
+    switch (N3DS_RENDER_TYPE) {
+    case (RENDER_BOTTOM):
+        direct_render = N3dsRendererDirect::supports(
+            GSP_SCREEN_HEIGHT_BOTTOM, GSP_SCREEN_WIDTH, width, height);
+        break;
+    case (RENDER_DEFAULT):
+        direct_render = N3dsRendererDirect::supports(
+            surface_width, surface_height, width, height);
+        break;
+    default:
+        direct_render = false;
+        break;
+    }
+    direct_render = direct_render && use_y2r;
+
+    if (use_y2r) {
+        Y2RU_ConversionParams y2r_parameters;
+        y2r_parameters.input_format = INPUT_YUV420_INDIV_8;
+        y2r_parameters.output_format = OUTPUT_RGB_16_565;
+        if (direct_render) {
+            // Rotate into the framebuffer layout, tiled for the display
+            // transfer
+            y2r_parameters.rotation = ROTATION_CLOCKWISE_90;
+            y2r_parameters.block_alignment = BLOCK_8_BY_8;
+        } else {
+            y2r_parameters.rotation = ROTATION_NONE;
+            y2r_parameters.block_alignment = BLOCK_LINE;
+        }
+        y2r_parameters.input_line_width = width;
+        y2r_parameters.input_lines = height;
+        y2r_parameters.standard_coefficient = COEFFICIENT_ITU_R_BT_709_SCALING;
+        y2r_parameters.alpha = 0xFF;
+        try {
+            y2r_engine = std::make_unique<N3dsY2rEngine>(
+                y2r_parameters, pixel_size, MOON_CTR_VIDEO_TEX_W);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "%s", e.what());
+            fprintf(stderr, "Using software color conversion\n");
+            direct_render = false;
+        }
     }
 
     switch (N3DS_RENDER_TYPE) {
     case (RENDER_BOTTOM):
+        if (direct_render) {
+            renderer = std::make_unique<N3dsRendererDirect>(
+                GFX_BOTTOM, GSP_SCREEN_HEIGHT_BOTTOM, GSP_SCREEN_WIDTH,
+                image_width, image_height, pixel_size);
+            break;
+        }
         renderer = std::make_unique<N3dsRendererBottom>(
             image_width, image_height, pixel_size);
         break;
@@ -103,78 +156,111 @@ static int n3ds_setup(int videoFormat, int width, int height, int redrawRate,
             pixel_size);
         break;
     default:
+        if (direct_render) {
+            renderer = std::make_unique<N3dsRendererDirect>(
+                GFX_TOP, surface_width, surface_height, image_width,
+                image_height, pixel_size);
+            break;
+        }
         renderer = std::make_unique<N3dsRendererTop>(
             surface_width, surface_height, image_width, image_height,
             pixel_size);
         break;
     }
+
+    frame_ring =
+        std::make_unique<FrameRing<ConvertedFrame>>(N3DS_FRAME_RING_SLOTS);
+    for (size_t i = 0; i < frame_ring->size(); i++) {
+        ConvertedFrame &slot = frame_ring->at(i);
+        slot.frame = av_frame_alloc();
+        slot.rgb = (u8 *)linearAlloc(MOON_CTR_VIDEO_TEX_W *
+                                     MOON_CTR_VIDEO_TEX_H * pixel_size);
+        if (!slot.frame || !slot.rgb) {
+            fprintf(stderr, "Out of memory!\n");
+            return -1;
+        }
+    }
+
+    // Decoding and starting the Y2R conversion stay on the receive thread,
+    // presentation runs on the system core so the stages overlap.
+    present_thread =
+        n3ds_thread_create(present_thread_main, NULL, N3DS_SYS_CORE);
+    if (present_thread == NULL) {
+        fprintf(stderr, "Failed to start the present thread\n");
+        return -1;
+    }
     return 0;
 }
 
 static void n3ds_cleanup() {
-    ffmpeg_destroy();
-    y2rExit();
-    linearFree(rgb_img_buffer);
-    renderer = nullptr;
-}
-
-static inline int write_yuv_to_framebuffer(const u8 **source, int width,
-                                           int height, int px_size) {
-    Handle conversion_finish_event_handle;
-    int status = 0;
-
-    status = Y2RU_SetSendingY(source[0], width * height, width, 0);
-    if (status) {
-        fprintf(stderr, "Y2RU_SetSendingY failed\n");
-        goto y2ru_failed;
+    if (frame_ring) {
+        frame_ring->stop();
     }
-
-    status = Y2RU_SetSendingU(source[1], width * height / 4, width / 2, 0);
-    if (status) {
-        fprintf(stderr, "Y2RU_SetSendingU failed\n");
-        goto y2ru_failed;
+    if (present_thread != NULL) {
+        threadJoin(present_thread, U64_MAX);
+        threadFree(present_thread);
+        present_thread = NULL;
     }
-
-    status = Y2RU_SetSendingV(source[2], width * height / 4, width / 2, 0);
-    if (status) {
-        fprintf(stderr, "Y2RU_SetSendingV failed\n");
-        goto y2ru_failed;
+    if (y2r_engine) {
+        printf("Y2R: %llu frames dropped\n", y2r_engine->dropped());
+        y2r_engine = nullptr;
     }
-
-    status = Y2RU_SetReceiving(
-        rgb_img_buffer, MOON_CTR_VIDEO_TEX_W * MOON_CTR_VIDEO_TEX_H * px_size,
-        width * px_size, (MOON_CTR_VIDEO_TEX_W - width) * px_size);
-    if (status) {
-        fprintf(stderr, "Y2RU_SetReceiving failed\n");
-        goto y2ru_failed;
+    renderer = nullptr;
+    if (frame_ring) {
+        for (size_t i = 0; i < frame_ring->size(); i++) {
+            ConvertedFrame &slot = frame_ring->at(i);
+            av_frame_free(&slot.frame);
+            if (slot.rgb) {
+                linearFree(slot.rgb);
+            }
+        }
+        frame_ring = nullptr;
     }
 
-    status = Y2RU_StartConversion();
-    if (status) {
-        fprintf(stderr, "Y2RU_StartConversion failed\n");
-        goto y2ru_failed;
-    }
+    ffmpeg_destroy();
+}
 
-    status = Y2RU_GetTransferEndEvent(&conversion_finish_event_handle);
-    if (status) {
-        fprintf(stderr, "Y2RU_GetTransferEndEvent failed\n");
-        goto y2ru_failed;
-    }
+static void present_thread_main(void *arg) {
+    ConvertedFrame *slot;
+    while ((slot = frame_ring->acquire_read()) != nullptr) {
+        // Present in time for the next VBlank, using whichever frame is the
+        // newest by then
+        N3dsRendererBase::wait_for_present_slot();
+        slot = frame_ring->take_newest(slot);
 
-    svcWaitSynchronization(conversion_finish_event_handle,
-                           10000000); // Wait up to 10ms.
-    svcCloseHandle(conversion_finish_event_handle);
-    renderer->write_px_to_framebuffer(rgb_img_buffer);
-    return DR_OK;
+        // Frames that failed to convert in time are dropped, not shown
+        if (!y2r_engine ||
+            y2r_engine->wait(&slot->job, N3DS_Y2R_TIMEOUT_NS)) {
+            if (y2r_engine && perf_stats_enabled()) {
+                perf_stats_push(PERF_STAT_CONVERT,
+                                N3DS_TICKS_TO_US(y2r_engine->convert_ticks()));
+            }
+            renderer->write_px_to_framebuffer(slot->rgb);
+            // Don't let Y2R overwrite rgb while the GPU still reads it
+            renderer->sync_source();
+        }
+        frame_ring->release_read(slot);
 
-y2ru_failed:
-    return -1;
+        if (perf_stats_enabled()) {
+            u64 dropped = frame_ring->dropped();
+            if (y2r_engine) {
+                dropped += y2r_engine->dropped();
+            }
+            perf_stats_set_counter(PERF_COUNTER_DROPPED, dropped);
+        }
+    }
 }
 
 static int n3ds_submit_decode_unit(PDECODE_UNIT decodeUnit) {
     PLENTRY entry = decodeUnit->bufferList;
     int length = 0;
 
+    if (perf_stats_enabled()) {
+        perf_stats_push(PERF_STAT_NETWORK,
+                        (LiGetMillis() - decodeUnit->receiveTimeMs) * 1000);
+        perf_stats_push(PERF_STAT_FRAME_BYTES, decodeUnit->fullLength);
+    }
+
     ensure_buf_size(&ffmpeg_buffer, &ffmpeg_buffer_size,
                     decodeUnit->fullLength + AV_INPUT_BUFFER_PADDING_SIZE);
 
@@ -183,13 +269,55 @@ static int n3ds_submit_decode_unit(PDECODE_UNIT decodeUnit) {
         length += entry->length;
         entry = entry->next;
     }
+    u64 decode_start = svcGetSystemTick();
     ffmpeg_decode((unsigned char *)ffmpeg_buffer, length);
 
     AVFrame *frame = ffmpeg_get_frame(false);
-    int status = write_yuv_to_framebuffer((const u8 **)frame->data, image_width,
-                                          image_height, pixel_size);
+    perf_stats_record(PERF_STAT_DECODE,
+                      N3DS_TICKS_TO_US(svcGetSystemTick() - decode_start));
+    if (frame == NULL) {
+        return DR_OK;
+    }
 
-    return status;
+    // Hand the frame to the present stage. If it is still busy with an older
+    // frame, the oldest waiting frame is replaced rather than stalling here.
+    ConvertedFrame *slot = frame_ring->acquire_write();
+    if (slot == nullptr) {
+        return DR_OK;
+    }
+
+    if (!y2r_engine) {
+        u64 convert_start = svcGetSystemTick();
+        yuv420_to_rgb565((const uint8_t *const *)frame->data, frame->linesize,
+                         image_width, image_height, (uint16_t *)slot->rgb,
+                         MOON_CTR_VIDEO_TEX_W);
+        // The GPU reads the buffer straight from memory
+        GSPGPU_FlushDataCache(slot->rgb, MOON_CTR_VIDEO_TEX_W * image_height *
+                                             pixel_size);
+        perf_stats_record(PERF_STAT_CONVERT,
+                          N3DS_TICKS_TO_US(svcGetSystemTick() - convert_start));
+        frame_ring->commit_write(slot);
+        return DR_OK;
+    }
+
+    // A recycled slot may still be the source of the running conversion
+    y2r_engine->wait(&slot->job, N3DS_Y2R_TIMEOUT_NS);
+    av_frame_unref(slot->frame);
+    if (av_frame_ref(slot->frame, frame) < 0) {
+        frame_ring->cancel_write(slot);
+        return DR_OK;
+    }
+
+    // Convert while the next packet is being received and decoded, the
+    // present stage waits on the job
+    if (!y2r_engine->start((const u8 *const *)slot->frame->data, slot->rgb,
+                           &slot->job)) {
+        frame_ring->cancel_write(slot);
+        return DR_OK;
+    }
+    frame_ring->commit_write(slot);
+
+    return DR_OK;
 }
 
 DECODER_RENDERER_CALLBACKS decoder_callbacks_n3ds = {
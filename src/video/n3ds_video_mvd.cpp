@@ -17,10 +17,14 @@
  * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "../util.h"
+#include "n3ds/FrameRing.hpp"
 #include "n3ds/N3dsRenderer.hpp"
 #include "video.h"
 
+#include "../n3ds/n3ds_thread.hpp"
+#include "../n3ds/perf_stats.hpp"
+#include "../util.h"
+
 #include <3ds.h>
 
 #include <Limelight.h>
@@ -33,6 +37,8 @@
 #include <stdlib.h>
 
 #define N3DS_DEC_BUFF_SIZE 23
+// MVD renders into one buffer while another is being presented
+#define N3DS_MVD_OUTPUT_BUFFERS 3
 
 // General decoder and renderer state
 static void *nal_unit_buffer;
@@ -40,8 +46,17 @@ static size_t nal_unit_buffer_size;
 static MVDSTD_Config mvdstd_config;
 
 static int image_width, image_height, surface_width, surface_height, pixel_size;
-static u8 *rgb_img_buffer;
 static bool first_frame = true;
+static u64 copies_avoided, bytes_avoided;
+
+// Bounds of the linear heap, set up by libctru at startup
+extern "C" u32 __ctru_linear_heap, __ctru_linear_heap_size;
+
+// MVD output buffers rotated between the decode thread and the present thread
+static std::unique_ptr<FrameRing<u8 *>> output_ring = nullptr;
+static Thread present_thread = NULL;
+
+static void present_thread_main(void *arg);
 
 static std::unique_ptr<N3dsRendererBase> renderer = nullptr;
 
@@ -55,6 +70,8 @@ static int n3ds_init(int videoFormat, int width, int height, int redrawRate,
     }
 
     first_frame = true;
+    copies_avoided = 0;
+    bytes_avoided = 0;
     int status =
         mvdstdInit(MVDMODE_VIDEOPROCESSING, MVD_INPUT_H264, MVD_OUTPUT_BGR565,
                    width * height * N3DS_DEC_BUFF_SIZE, NULL);
@@ -75,11 +92,14 @@ static int n3ds_init(int videoFormat, int width, int height, int redrawRate,
     image_width = width;
     image_height = height;
     pixel_size = gspGetBytesPerPixel(px_fmt);
-    rgb_img_buffer = (u8 *)linearAlloc(MOON_CTR_VIDEO_TEX_W *
-                                       MOON_CTR_VIDEO_TEX_H * pixel_size);
-    if (!rgb_img_buffer) {
-        fprintf(stderr, "Out of memory!\n");
-        return -1;
+    output_ring = std::make_unique<FrameRing<u8 *>>(N3DS_MVD_OUTPUT_BUFFERS);
+    for (size_t i = 0; i < output_ring->size(); i++) {
+        output_ring->at(i) = (u8 *)linearAlloc(
+            MOON_CTR_VIDEO_TEX_W * MOON_CTR_VIDEO_TEX_H * pixel_size);
+        if (!output_ring->at(i)) {
+            fprintf(stderr, "Out of memory!\n");
+            return -1;
+        }
     }
 
     ensure_linear_buf_size(&nal_unit_buffer, &nal_unit_buffer_size,
@@ -87,7 +107,7 @@ static int n3ds_init(int videoFormat, int width, int height, int redrawRate,
                                AV_INPUT_BUFFER_PADDING_SIZE);
     mvdstdGenerateDefaultConfig(&mvdstd_config, image_width, image_height,
                                 image_width, image_height, NULL,
-                                (u32 *)rgb_img_buffer, NULL);
+                                (u32 *)output_ring->at(0), NULL);
 
     // Place within the 1024x512 buffer
     mvdstd_config.flag_x104 = 1;
@@ -116,49 +136,139 @@ static int n3ds_init(int videoFormat, int width, int height, int redrawRate,
             pixel_size);
         break;
     }
+
+    // The present thread waits on the GPU while MVD works on the next frame
+    present_thread =
+        n3ds_thread_create(present_thread_main, NULL, N3DS_EXTRA_CORE);
+    if (present_thread == NULL) {
+        fprintf(stderr, "Failed to start the present thread\n");
+        return -1;
+    }
     return 0;
 }
 
 // This function must be called after
 // decoding is finished
 static void n3ds_destroy(void) {
+    if (output_ring) {
+        output_ring->stop();
+    }
+    if (present_thread != NULL) {
+        threadJoin(present_thread, U64_MAX);
+        threadFree(present_thread);
+        present_thread = NULL;
+    }
+
     y2rExit();
     mvdstdExit();
     linearFree(nal_unit_buffer);
-    linearFree(rgb_img_buffer);
+    if (output_ring) {
+        for (size_t i = 0; i < output_ring->size(); i++) {
+            linearFree(output_ring->at(i));
+        }
+        output_ring = nullptr;
+    }
     renderer = nullptr;
 }
 
 // packets must be decoded in order
-// indata must be inlen + AV_INPUT_BUFFER_PADDING_SIZE in length
-static inline int n3ds_decode(unsigned char *indata, int inlen) {
+// Returns true when a picture was rendered into outdata
+static inline bool n3ds_decode(unsigned char *indata, int inlen, u8 *outdata) {
+    u64 start_ticks = svcGetSystemTick();
     int ret = mvdstdProcessVideoFrame(indata, inlen, 1, NULL);
+    u64 decoded_ticks = svcGetSystemTick();
+    perf_stats_record(PERF_STAT_DECODE,
+                      N3DS_TICKS_TO_US(decoded_ticks - start_ticks));
     if (ret != MVD_STATUS_PARAMSET && ret != MVD_STATUS_INCOMPLETEPROCESSING) {
+        // mvdstdRenderVideoFrame applies the config, retargeting the output
+        mvdstd_config.physaddr_outdata0 = osConvertVirtToPhys(outdata);
         mvdstdRenderVideoFrame(&mvdstd_config, true);
+        perf_stats_record(PERF_STAT_CONVERT,
+                          N3DS_TICKS_TO_US(svcGetSystemTick() - decoded_ticks));
+        return true;
     }
-    return 0;
+    return false;
+}
+
+static void present_thread_main(void *arg) {
+    u8 **slot;
+    while ((slot = output_ring->acquire_read()) != nullptr) {
+        // Present in time for the next VBlank, using whichever frame is the
+        // newest by then
+        N3dsRendererBase::wait_for_present_slot();
+        slot = output_ring->take_newest(slot);
+
+        renderer->write_px_to_framebuffer(*slot);
+        // Once the GPU has copied the buffer out, MVD can safely render into
+        // it again while the draw and present are still in flight
+        renderer->sync_source();
+        output_ring->release_read(slot);
+
+        if (perf_stats_enabled()) {
+            perf_stats_set_counter(PERF_COUNTER_DROPPED,
+                                   output_ring->dropped());
+        }
+    }
+}
+
+// MVD reads the bitstream by physical address, so a decode unit can only be
+// handed over as is when it is a single buffer in the linear heap. The
+// padding MVD may read past the end has to be in the heap as well.
+static bool in_linear_heap(const void *data, int length) {
+    u32 start = (u32)data;
+    return start >= __ctru_linear_heap &&
+           start + length + AV_INPUT_BUFFER_PADDING_SIZE <=
+               __ctru_linear_heap + __ctru_linear_heap_size;
 }
 
 static int n3ds_submit_decode_unit(PDECODE_UNIT decodeUnit) {
-    u64 start_ticks = svcGetSystemTick();
+    if (perf_stats_enabled()) {
+        perf_stats_push(PERF_STAT_NETWORK,
+                        (LiGetMillis() - decodeUnit->receiveTimeMs) * 1000);
+        perf_stats_push(PERF_STAT_FRAME_BYTES, decodeUnit->fullLength);
+    }
+
+    // Recycles the oldest undisplayed buffer if presenting has fallen behind
+    u8 **slot = output_ring->acquire_write();
+    if (slot == nullptr) {
+        return DR_OK;
+    }
+
     PLENTRY entry = decodeUnit->bufferList;
+    unsigned char *bitstream;
     int length = 0;
 
-    ensure_linear_buf_size(&nal_unit_buffer, &nal_unit_buffer_size,
-                           decodeUnit->fullLength +
-                               AV_INPUT_BUFFER_PADDING_SIZE);
-
-    while (entry != NULL) {
-        memcpy(nal_unit_buffer + length, entry->data, entry->length);
-        length += entry->length;
-        entry = entry->next;
+    if (entry != NULL && entry->next == NULL &&
+        in_linear_heap(entry->data, entry->length)) {
+        bitstream = (unsigned char *)entry->data;
+        length = entry->length;
+        copies_avoided++;
+        bytes_avoided += length;
+        if (perf_stats_enabled()) {
+            perf_stats_set_counter(PERF_COUNTER_COPIES_AVOIDED,
+                                   copies_avoided);
+            perf_stats_set_counter(PERF_COUNTER_BYTES_AVOIDED, bytes_avoided);
+        }
+    } else {
+        ensure_linear_buf_size(&nal_unit_buffer, &nal_unit_buffer_size,
+                               decodeUnit->fullLength +
+                                   AV_INPUT_BUFFER_PADDING_SIZE);
+        while (entry != NULL) {
+            memcpy((u8 *)nal_unit_buffer + length, entry->data,
+                   entry->length);
+            length += entry->length;
+            entry = entry->next;
+        }
+        bitstream = (unsigned char *)nal_unit_buffer;
     }
-    GSPGPU_FlushDataCache(nal_unit_buffer, length);
-
-    n3ds_decode((unsigned char *)nal_unit_buffer, length);
-    renderer->perf_decode_ticks = svcGetSystemTick() - start_ticks;
+    GSPGPU_FlushDataCache(bitstream, length);
 
-    renderer->write_px_to_framebuffer(rgb_img_buffer);
+    bool rendered = n3ds_decode(bitstream, length, *slot);
+    if (rendered) {
+        output_ring->commit_write(slot);
+    } else {
+        output_ring->cancel_write(slot);
+    }
 
     // If MVD never gets an IDR frame, everything shows up gray
     if (first_frame) {
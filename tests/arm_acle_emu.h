@@ -0,0 +1,43 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// C versions of the ARMv6 SIMD intrinsics used by the YUV kernel, so the
+// kernel itself can be checked against the scalar reference on the host.
+
+#include <cstdint>
+
+static inline int16_t acle_lo(uint32_t x) { return (int16_t)(x & 0xFFFF); }
+static inline int16_t acle_hi(uint32_t x) { return (int16_t)(x >> 16); }
+
+static inline int32_t __ssub16(uint32_t a, uint32_t b) {
+    uint16_t lo = (uint16_t)(acle_lo(a) - acle_lo(b));
+    uint16_t hi = (uint16_t)(acle_hi(a) - acle_hi(b));
+    return (int32_t)((uint32_t)lo | ((uint32_t)hi << 16));
+}
+
+static inline int32_t __smuad(uint32_t a, uint32_t b) {
+    return (int32_t)acle_lo(a) * acle_lo(b) + (int32_t)acle_hi(a) * acle_hi(b);
+}
+
+static inline uint32_t __uxtb16(uint32_t x) { return x & 0x00FF00FF; }
+
+static inline uint32_t __usat(int32_t x, int bits) {
+    int32_t max = (1 << bits) - 1;
+    return (uint32_t)(x < 0 ? 0 : (x > max ? max : x));
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio/n3ds/AudioJitterBuffer.hpp"
+#include "test_common.hpp"
+
+#include <random>
+
+#define SAMPLE_RATE 48000
+#define PACKET_SAMPLES 240
+#define TARGET_SAMPLES 2400
+#define CAPACITY_SAMPLES 3840
+
+// Host and DSP clocks, with the playback side only seeing the rate once
+// take_rate_change() says it is worth applying, as on the 3DS
+struct AudioSim {
+    AudioJitterBuffer buffer{SAMPLE_RATE, TARGET_SAMPLES, CAPACITY_SAMPLES};
+    double queued = 0;
+    double applied_rate = SAMPLE_RATE;
+    std::mt19937 rng{7};
+
+    // Feeds seconds of audio from a host whose clock runs fast by drift.
+    // jitter_ms delays each packet by up to that much, catching up later.
+    void run(double seconds, double drift, double jitter_ms,
+             double *avg_queued = nullptr) {
+        double send_interval = PACKET_SAMPLES / (SAMPLE_RATE * (1 + drift));
+        std::uniform_real_distribution<double> delay(0, jitter_ms / 1000);
+        int packets = seconds / send_interval;
+        double sum = 0;
+        double now = 0;
+        double late_until = 0;
+        for (int i = 0; i < packets; i++) {
+            double arrival = i * send_interval + delay(rng);
+            arrival = std::max(arrival, late_until);
+            late_until = arrival;
+
+            if (!buffer.holding()) {
+                queued = std::max(0.0, queued - applied_rate * (arrival - now));
+            }
+            now = arrival;
+
+            // The depth the buffer sees, before the packet is queued
+            sum += queued;
+            if (buffer.on_packet((int)queued, PACKET_SAMPLES) ==
+                AudioJitterBuffer::JITTER_PLAY) {
+                queued += PACKET_SAMPLES;
+            }
+            if (buffer.take_rate_change()) {
+                applied_rate = buffer.rate();
+            }
+        }
+        if (avg_queued) {
+            *avg_queued = sum / packets;
+        }
+    }
+};
+
+static void test_starts_at_target() {
+    AudioJitterBuffer buffer(SAMPLE_RATE, TARGET_SAMPLES, CAPACITY_SAMPLES);
+    CHECK(buffer.holding());
+
+    // Playback stays paused until a full target is queued
+    int queued = 0;
+    while (queued + PACKET_SAMPLES < TARGET_SAMPLES) {
+        CHECK(buffer.on_packet(queued, PACKET_SAMPLES) ==
+              AudioJitterBuffer::JITTER_PLAY);
+        queued += PACKET_SAMPLES;
+        CHECK(buffer.holding());
+    }
+    buffer.on_packet(queued, PACKET_SAMPLES);
+    CHECK(!buffer.holding());
+    CHECK_NEAR(buffer.rate(), SAMPLE_RATE, 1);
+}
+
+static void check_drift_corrected(double drift) {
+    AudioSim sim;
+    double avg;
+    // The drift estimate settles over a couple of minutes
+    sim.run(180, drift, 0);
+    uint64_t drops = sim.buffer.drops;
+    uint64_t underruns = sim.buffer.underruns;
+    sim.run(30, drift, 0, &avg);
+
+    // The applied rate matches the host clock to within a few steps, and the
+    // queue holds the target latency
+    CHECK_NEAR(sim.applied_rate, SAMPLE_RATE * (1 + drift), 2);
+    CHECK_NEAR(avg, TARGET_SAMPLES, TARGET_SAMPLES * 0.05);
+    CHECK_EQ(sim.buffer.drops, drops);
+    CHECK_EQ(sim.buffer.underruns, underruns);
+}
+
+static void test_fast_host_clock() { check_drift_corrected(0.002); }
+
+static void test_slow_host_clock() { check_drift_corrected(-0.002); }
+
+static void test_rate_correction_is_bounded() {
+    // 1% is beyond what is corrected without an audible pitch shift
+    AudioSim sim;
+    sim.run(60, 0.01, 0);
+    CHECK(sim.applied_rate <= SAMPLE_RATE * 1.005 + 1);
+    CHECK(sim.buffer.drops > 0);
+}
+
+static void test_absorbs_jitter() {
+    AudioSim sim;
+    double avg;
+    sim.run(30, 0, 20);
+    uint64_t underruns = sim.buffer.underruns;
+    sim.run(30, 0, 20, &avg);
+
+    // 20 ms of jitter fits well within 50 ms of target latency
+    CHECK_EQ(sim.buffer.underruns, underruns);
+    CHECK_NEAR(avg, TARGET_SAMPLES, TARGET_SAMPLES * 0.25);
+    CHECK_NEAR(sim.applied_rate, SAMPLE_RATE, SAMPLE_RATE * 0.002);
+}
+
+static void test_underrun_refills() {
+    AudioSim sim;
+    sim.run(5, 0, 0);
+    CHECK_EQ(sim.buffer.underruns, 0);
+
+    // A stall longer than the queue empties it
+    sim.queued = 0;
+    sim.buffer.on_packet(0, PACKET_SAMPLES);
+    CHECK_EQ(sim.buffer.underruns, 1);
+    CHECK(sim.buffer.holding());
+
+    sim.run(5, 0, 0);
+    CHECK(!sim.buffer.holding());
+    CHECK_EQ(sim.buffer.underruns, 1);
+}
+
+static void test_burst_dropped() {
+    AudioSim sim;
+    sim.run(5, 0, 0);
+
+    // A burst beyond the headroom is skipped rather than queued
+    int queued = (int)sim.queued;
+    uint64_t drops = sim.buffer.drops;
+    while (sim.buffer.on_packet(queued, PACKET_SAMPLES) ==
+           AudioJitterBuffer::JITTER_PLAY) {
+        queued += PACKET_SAMPLES;
+    }
+    CHECK_EQ(sim.buffer.drops, drops + 1);
+    CHECK(queued + PACKET_SAMPLES > TARGET_SAMPLES * 3 / 2);
+    CHECK(queued <= CAPACITY_SAMPLES - PACKET_SAMPLES);
+}
+
+int main() {
+    RUN_TEST(test_starts_at_target);
+    RUN_TEST(test_fast_host_clock);
+    RUN_TEST(test_slow_host_clock);
+    RUN_TEST(test_rate_correction_is_bounded);
+    RUN_TEST(test_absorbs_jitter);
+    RUN_TEST(test_underrun_refills);
+    RUN_TEST(test_burst_dropped);
+    return TEST_RESULT();
+}
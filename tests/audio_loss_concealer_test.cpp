@@ -0,0 +1,120 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio/n3ds/AudioLossConcealer.hpp"
+#include "test_common.hpp"
+
+#include <string>
+
+// Replays a packet stream through the concealer the way n3ds_audio.cpp
+// drives the decoder. '+' is a packet that arrived, '-' one that was lost.
+// Each frame handed to the decoder is written out as '+' for a normal
+// decode, 'F' for an FEC decode and 'C' for concealment.
+static std::string replay(const std::string &stream, int max_deferred = 1,
+                          AudioLossConcealer *out = nullptr) {
+    AudioLossConcealer concealer(max_deferred);
+    std::string frames;
+    for (char packet : stream) {
+        if (packet == '-') {
+            frames.append(concealer.on_lost(), 'C');
+            continue;
+        }
+        AudioLossPlan plan = concealer.on_packet();
+        frames.append(plan.plc_frames, 'C');
+        if (plan.fec_frame) {
+            frames += 'F';
+        }
+        frames += '+';
+    }
+    if (out) {
+        *out = concealer;
+    }
+    return frames;
+}
+
+static void check_replay(const std::string &stream,
+                         const std::string &expected) {
+    std::string frames = replay(stream);
+    if (frames != expected) {
+        fprintf(stderr, "  %s -> %s, expected %s\n", stream.c_str(),
+                frames.c_str(), expected.c_str());
+    }
+    CHECK(frames == expected);
+}
+
+static void test_no_loss() { check_replay("++++", "++++"); }
+
+static void test_single_loss_recovered_with_fec() {
+    check_replay("++-++", "++F++");
+    check_replay("-+", "F+");
+}
+
+static void test_burst_concealed_then_recovered() {
+    // Only the newest loss can come back from the next packet's FEC data,
+    // older ones are concealed as they happen to keep the queue fed
+    check_replay("+---+", "+CCF+");
+    check_replay("+--+-+--+", "+CF+F+CF+");
+}
+
+static void test_timeline_preserved() {
+    // A Wi-Fi trace with a mix of isolated losses and bursts
+    const std::string stream = "++++-+++++--++++-+-++++---+++++++-++++----++";
+    AudioLossConcealer concealer;
+    std::string frames = replay(stream, 1, &concealer);
+
+    // Every packet slot becomes exactly one frame, at the same position
+    CHECK_EQ(frames.size(), stream.size());
+    for (size_t i = 0; i < stream.size() && i < frames.size(); i++) {
+        CHECK((stream[i] == '+') == (frames[i] == '+'));
+    }
+
+    int lost = 0, bursts = 0;
+    for (size_t i = 0; i < stream.size(); i++) {
+        lost += stream[i] == '-';
+        bursts += stream[i] == '-' && (i + 1 == stream.size() ||
+                                       stream[i + 1] == '+');
+    }
+    CHECK_EQ(concealer.recovered, bursts);
+    CHECK_EQ(concealer.concealed, lost - bursts);
+}
+
+static void test_trailing_loss_waits_for_packet() {
+    AudioLossConcealer concealer;
+    std::string frames = replay("++-", 1, &concealer);
+    CHECK(frames == "++");
+    CHECK_EQ(concealer.concealed, 0);
+    CHECK_EQ(concealer.recovered, 0);
+}
+
+static void test_deeper_deferral() {
+    check_replay("+--+", "+CF+");
+    std::string frames = replay("+---+", 2);
+    CHECK(frames == "+CCF+");
+    // With two held back, nothing is emitted until the third loss
+    frames = replay("+--", 2);
+    CHECK(frames == "+");
+}
+
+int main() {
+    RUN_TEST(test_no_loss);
+    RUN_TEST(test_single_loss_recovered_with_fec);
+    RUN_TEST(test_burst_concealed_then_recovered);
+    RUN_TEST(test_timeline_preserved);
+    RUN_TEST(test_trailing_loss_waits_for_packet);
+    RUN_TEST(test_deeper_deferral);
+    return TEST_RESULT();
+}
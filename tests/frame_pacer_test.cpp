@@ -0,0 +1,119 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_common.hpp"
+#include "video/n3ds/FramePacer.hpp"
+
+#define NOMINAL_PERIOD 1000
+
+// Feeds VBlanks every period ticks starting at start, returns the last one
+static uint64_t run_vblanks(FramePacer &pacer, uint64_t start,
+                            uint64_t period, int count) {
+    uint64_t now = start;
+    for (int i = 0; i < count; i++) {
+        now = start + i * period;
+        pacer.on_vblank(now);
+    }
+    return now;
+}
+
+static void test_period_follows_measured_vblanks() {
+    FramePacer pacer(NOMINAL_PERIOD);
+    CHECK_EQ(pacer.period(), NOMINAL_PERIOD);
+
+    uint64_t last = run_vblanks(pacer, 10000, 1020, 100);
+    CHECK_NEAR((double)pacer.period(), 1020.0, 8.0);
+
+    // A gap from missed events doesn't count as a period
+    uint64_t period = pacer.period();
+    pacer.on_vblank(last + 10 * NOMINAL_PERIOD);
+    CHECK_EQ(pacer.period(), period);
+    pacer.on_vblank(last + 10 * NOMINAL_PERIOD + NOMINAL_PERIOD / 4);
+    CHECK_EQ(pacer.period(), period);
+}
+
+static void test_no_vblank_yet() {
+    FramePacer pacer(NOMINAL_PERIOD);
+    pacer.on_present_cost(200);
+    // Nothing to pace against, present right away without counting it late
+    CHECK_EQ(pacer.present_deadline(5000), 5000);
+    CHECK_EQ(pacer.late(), 0);
+}
+
+static void test_deadline_before_next_vblank() {
+    FramePacer pacer(NOMINAL_PERIOD);
+    uint64_t last = run_vblanks(pacer, 10000, NOMINAL_PERIOD, 10);
+    pacer.on_present_cost(200);
+
+    CHECK_EQ(pacer.ticks_until_vblank(last + 100), 900);
+    CHECK_EQ(pacer.present_deadline(last + 100), last + 800);
+    // Exactly at the deadline still makes it
+    CHECK_EQ(pacer.present_deadline(last + 800), last + 800);
+    // Several periods after the last event the phase still holds
+    CHECK_EQ(pacer.present_deadline(last + 3 * NOMINAL_PERIOD + 100),
+             last + 3 * NOMINAL_PERIOD + 800);
+    CHECK_EQ(pacer.late(), 0);
+}
+
+static void test_late_frame_waits_for_following_vblank() {
+    FramePacer pacer(NOMINAL_PERIOD);
+    uint64_t last = run_vblanks(pacer, 10000, NOMINAL_PERIOD, 10);
+    pacer.on_present_cost(200);
+
+    // The next VBlank is 100 ticks away, the present takes 200
+    CHECK_EQ(pacer.present_deadline(last + 900), last + 1800);
+    CHECK_EQ(pacer.late(), 1);
+    CHECK_EQ(pacer.present_deadline(last + 801), last + 1800);
+    CHECK_EQ(pacer.late(), 2);
+}
+
+static void test_present_longer_than_period() {
+    FramePacer pacer(NOMINAL_PERIOD);
+    uint64_t last = run_vblanks(pacer, 10000, NOMINAL_PERIOD, 10);
+    pacer.on_present_cost(2500);
+
+    // Only the VBlank three periods out can still be made
+    uint64_t deadline = pacer.present_deadline(last + 100);
+    CHECK_EQ(deadline, last + 3 * NOMINAL_PERIOD - 2500);
+    CHECK(deadline >= last + 100);
+    CHECK_EQ(pacer.late(), 1);
+}
+
+static void test_present_cost_average() {
+    FramePacer pacer(NOMINAL_PERIOD);
+    uint64_t last = run_vblanks(pacer, 10000, NOMINAL_PERIOD, 10);
+
+    // The first sample is taken as is, later ones are smoothed
+    pacer.on_present_cost(400);
+    CHECK_EQ(pacer.present_deadline(last + 100), last + 600);
+    pacer.on_present_cost(800);
+    CHECK_EQ(pacer.present_deadline(last + 100), last + 1000 - 450);
+    for (int i = 0; i < 100; i++) {
+        pacer.on_present_cost(800);
+    }
+    CHECK_NEAR((double)pacer.present_deadline(last + 100), last + 200.0, 8.0);
+}
+
+int main() {
+    RUN_TEST(test_period_follows_measured_vblanks);
+    RUN_TEST(test_no_vblank_yet);
+    RUN_TEST(test_deadline_before_next_vblank);
+    RUN_TEST(test_late_frame_waits_for_following_vblank);
+    RUN_TEST(test_present_longer_than_period);
+    RUN_TEST(test_present_cost_average);
+    return TEST_RESULT();
+}
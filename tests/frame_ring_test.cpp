@@ -0,0 +1,209 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_common.hpp"
+#include "video/n3ds/FrameRing.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+static void write_frame(FrameRing<int> &ring, int frame) {
+    int *slot = ring.acquire_write();
+    CHECK(slot != nullptr);
+    if (slot) {
+        *slot = frame;
+        ring.commit_write(slot);
+    }
+}
+
+// Reads one frame, -1 if the ring was stopped
+static int read_frame(FrameRing<int> &ring) {
+    int *slot = ring.acquire_read();
+    if (slot == nullptr) {
+        return -1;
+    }
+    int frame = *slot;
+    ring.release_read(slot);
+    return frame;
+}
+
+static void test_order_without_drops() {
+    FrameRing<int> ring(3);
+    int frame = 0;
+    for (int round = 0; round < 100; round++) {
+        // Up to two frames in flight, as many as fit without recycling
+        int batch = round % 2 + 1;
+        for (int i = 0; i < batch; i++) {
+            write_frame(ring, frame + i);
+        }
+        for (int i = 0; i < batch; i++) {
+            CHECK_EQ(read_frame(ring), frame + i);
+        }
+        frame += batch;
+    }
+    CHECK_EQ(ring.committed(), frame);
+    CHECK_EQ(ring.dropped(), 0);
+}
+
+static void test_drop_oldest_when_full() {
+    FrameRing<int> ring(3);
+    for (int frame = 0; frame < 3; frame++) {
+        write_frame(ring, frame);
+    }
+
+    // Every slot is ready, the producer takes over the oldest one
+    int *slot = ring.acquire_write();
+    CHECK(slot != nullptr);
+    if (slot) {
+        CHECK_EQ(*slot, 0);
+        *slot = 3;
+        ring.commit_write(slot);
+    }
+    CHECK_EQ(ring.dropped(), 1);
+
+    CHECK_EQ(read_frame(ring), 1);
+    CHECK_EQ(read_frame(ring), 2);
+    CHECK_EQ(read_frame(ring), 3);
+}
+
+static void test_drop_skips_frame_being_read() {
+    FrameRing<int> ring(3);
+    write_frame(ring, 0);
+    int *reading = ring.acquire_read();
+    write_frame(ring, 1);
+    write_frame(ring, 2);
+
+    // Frame 0 is held by the consumer, so frame 1 is the one recycled
+    write_frame(ring, 3);
+    CHECK_EQ(ring.dropped(), 1);
+    CHECK(reading != nullptr && *reading == 0);
+    if (reading) {
+        ring.release_read(reading);
+    }
+    CHECK_EQ(read_frame(ring), 2);
+    CHECK_EQ(read_frame(ring), 3);
+}
+
+static void test_cancel_write_returns_slot() {
+    FrameRing<int> ring(3);
+    for (int i = 0; i < 10; i++) {
+        int *slot = ring.acquire_write();
+        CHECK(slot != nullptr);
+        if (slot) {
+            ring.cancel_write(slot);
+        }
+    }
+    CHECK_EQ(ring.committed(), 0);
+
+    // All three slots are free again, filling them drops nothing
+    for (int frame = 0; frame < 3; frame++) {
+        write_frame(ring, frame);
+    }
+    CHECK_EQ(ring.dropped(), 0);
+    for (int frame = 0; frame < 3; frame++) {
+        CHECK_EQ(read_frame(ring), frame);
+    }
+}
+
+static void test_stop_wakes_reader() {
+    FrameRing<int> ring(3);
+    std::atomic<bool> returned{false};
+    int *result = &ring.at(0);
+    std::thread reader([&] {
+        result = ring.acquire_read();
+        returned = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!returned);
+    ring.stop();
+    reader.join();
+    CHECK(returned);
+    CHECK(result == nullptr);
+
+    // Stays stopped even with frames ready
+    write_frame(ring, 0);
+    CHECK_EQ(read_frame(ring), -1);
+}
+
+static void test_take_newest() {
+    FrameRing<int> ring(4);
+    for (int frame = 0; frame < 3; frame++) {
+        write_frame(ring, frame);
+    }
+
+    int *slot = ring.acquire_read();
+    CHECK(slot != nullptr && *slot == 0);
+    slot = ring.take_newest(slot);
+    CHECK(slot != nullptr && *slot == 2);
+    // The held frame and the one between are both given up
+    CHECK_EQ(ring.dropped(), 2);
+
+    // Nothing newer is ready, the same frame is kept
+    CHECK(ring.take_newest(slot) == slot);
+    CHECK_EQ(ring.dropped(), 2);
+    ring.release_read(slot);
+
+    // Every slot is free again
+    for (int frame = 3; frame < 7; frame++) {
+        write_frame(ring, frame);
+    }
+    CHECK_EQ(ring.dropped(), 2);
+    CHECK_EQ(read_frame(ring), 3);
+}
+
+static void test_threaded_order() {
+    const int frames = 200000;
+    FrameRing<int> ring(3);
+    int read = 0;
+    int last = -1;
+    bool ordered = true;
+
+    std::thread consumer([&] {
+        int frame;
+        while ((frame = read_frame(ring)) != -1) {
+            ordered &= frame > last;
+            last = frame;
+            read++;
+            if (frame == frames - 1) {
+                break;
+            }
+        }
+    });
+    for (int frame = 0; frame < frames; frame++) {
+        write_frame(ring, frame);
+    }
+    consumer.join();
+
+    // Frames may be dropped but never reordered or repeated
+    CHECK(ordered);
+    CHECK_EQ(last, frames - 1);
+    CHECK_EQ(ring.committed(), frames);
+    CHECK_EQ(read + ring.dropped(), frames);
+}
+
+int main() {
+    RUN_TEST(test_order_without_drops);
+    RUN_TEST(test_drop_oldest_when_full);
+    RUN_TEST(test_drop_skips_frame_being_read);
+    RUN_TEST(test_cancel_write_returns_slot);
+    RUN_TEST(test_stop_wakes_reader);
+    RUN_TEST(test_take_newest);
+    RUN_TEST(test_threaded_order);
+    return TEST_RESULT();
+}
@@ -0,0 +1,204 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_common.hpp"
+#include "video/n3ds/GpuJobQueue.hpp"
+
+#include <string>
+#include <vector>
+
+// Stands in for the GX calls, recording the order the engines were started
+class MockGpuTarget : public GpuJobTarget {
+  public:
+    MockGpuTarget(const std::string &name_in, int presents_in = 2)
+        : name(name_in), presents(presents_in) {}
+
+    void start_tile(const GpuJob &job) override {
+        log->push_back(name + " tile " + std::to_string(job.tex_index));
+    }
+    void start_draw(const GpuJob &job) override {
+        log->push_back(name + " draw " + std::to_string(job.tex_index));
+    }
+    int present_transfer_count(const GpuJob &job) override { return presents; }
+    void start_present(const GpuJob &job, int transfer) override {
+        log->push_back(name + " present " + std::to_string(transfer));
+    }
+    void finish(const GpuJob &job) override { log->push_back(name + " swap"); }
+
+    std::string name;
+    int presents;
+    std::vector<std::string> *log = nullptr;
+};
+
+static std::vector<std::string> events;
+
+static MockGpuTarget make_target(const std::string &name, int presents = 2) {
+    MockGpuTarget target(name, presents);
+    target.log = &events;
+    return target;
+}
+
+static bool expect(const std::vector<std::string> &expected) {
+    bool match = events == expected;
+    if (!match) {
+        fprintf(stderr, "  got:");
+        for (const std::string &event : events) {
+            fprintf(stderr, " [%s]", event.c_str());
+        }
+        fprintf(stderr, "\n");
+    }
+    events.clear();
+    return match;
+}
+
+static void test_single_frame_stages() {
+    GpuJobQueue queue(4);
+    MockGpuTarget top = make_target("top");
+    events.clear();
+
+    CHECK(queue.submit(&top, &top, 0, 10));
+    CHECK(expect({"top tile 0"}));
+    CHECK(!queue.wait_sources_released(0));
+
+    queue.on_transfer_done();
+    CHECK(expect({"top draw 0"}));
+    CHECK(queue.wait_sources_released(0));
+    CHECK(!queue.wait_idle(&top, 0));
+
+    queue.on_draw_done();
+    CHECK(expect({"top present 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top present 1"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top swap"}));
+    CHECK(queue.wait_idle(nullptr, 0));
+}
+
+static void test_next_tile_overlaps_draw() {
+    GpuJobQueue queue(4);
+    MockGpuTarget top = make_target("top", 1);
+    events.clear();
+
+    CHECK(queue.submit(&top, &top, 0, 10));
+    CHECK(queue.submit(&top, &top, 1, 10));
+    CHECK(expect({"top tile 0"}));
+
+    // The second texture is tiled while the first frame is drawn
+    queue.on_transfer_done();
+    CHECK(expect({"top tile 1", "top draw 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({}));
+
+    // The render buffer is not redrawn until the first frame was presented
+    queue.on_draw_done();
+    CHECK(expect({"top present 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top swap", "top draw 1"}));
+    queue.on_draw_done();
+    CHECK(expect({"top present 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top swap"}));
+    CHECK(queue.wait_idle(&top, 0));
+}
+
+static void test_texture_not_retiled_while_drawn() {
+    GpuJobQueue queue(4);
+    MockGpuTarget top = make_target("top", 1);
+    events.clear();
+
+    CHECK(queue.submit(&top, &top, 0, 10));
+    CHECK(queue.submit(&top, &top, 0, 10));
+    CHECK(expect({"top tile 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top draw 0"}));
+
+    // Retiling texture 0 has to wait for the draw reading it
+    queue.on_draw_done();
+    CHECK(expect({"top present 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top swap", "top tile 0"}));
+}
+
+static void test_targets_share_engines() {
+    GpuJobQueue queue(4);
+    MockGpuTarget top = make_target("top", 1);
+    MockGpuTarget bottom = make_target("bottom", 1);
+    events.clear();
+
+    CHECK(queue.submit(&top, &top, 0, 10));
+    CHECK(queue.submit(&bottom, &bottom, 0, 10));
+    CHECK(expect({"top tile 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"bottom tile 0", "top draw 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({}));
+
+    // The bottom target has its own render buffer so it only waits on the
+    // 3D engine, not on the top frame being presented
+    queue.on_draw_done();
+    CHECK(expect({"top present 0", "bottom draw 0"}));
+    queue.on_transfer_done();
+    CHECK(expect({"top swap"}));
+    queue.on_draw_done();
+    CHECK(expect({"bottom present 0"}));
+}
+
+static void test_present_only_skips_draw() {
+    GpuJobQueue queue(4);
+    MockGpuTarget direct = make_target("direct", 1);
+    events.clear();
+
+    CHECK(queue.submit(&direct, &direct, 0, 10, true));
+    CHECK(expect({"direct present 0"}));
+    CHECK(!queue.wait_sources_released(0));
+    queue.on_transfer_done();
+    CHECK(expect({"direct swap"}));
+    CHECK(queue.wait_sources_released(0));
+}
+
+static void test_full_queue_times_out() {
+    GpuJobQueue queue(1);
+    MockGpuTarget top = make_target("top", 1);
+    events.clear();
+
+    CHECK(queue.submit(&top, &top, 0, 10));
+    CHECK(!queue.submit(&top, &top, 1, 10));
+    CHECK(!queue.wait_idle(&top, 10));
+
+    // Lost completions are recovered from by forgetting every job
+    queue.reset();
+    CHECK(queue.wait_idle(nullptr, 0));
+    events.clear();
+    CHECK(queue.submit(&top, &top, 1, 10));
+    CHECK(expect({"top tile 1"}));
+
+    // Completions arriving after a reset are ignored
+    queue.reset();
+    queue.on_transfer_done();
+    queue.on_draw_done();
+    CHECK(expect({}));
+}
+
+int main() {
+    RUN_TEST(test_single_frame_stages);
+    RUN_TEST(test_next_tile_overlaps_draw);
+    RUN_TEST(test_texture_not_retiled_while_drawn);
+    RUN_TEST(test_targets_share_engines);
+    RUN_TEST(test_present_only_skips_draw);
+    RUN_TEST(test_full_queue_times_out);
+    return TEST_RESULT();
+}
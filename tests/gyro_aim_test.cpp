@@ -0,0 +1,184 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/n3ds/GyroAim.hpp"
+#include "test_common.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Poll rate and filter settings n3ds_main.cpp streams with
+#define POLL_HZ 250
+#define DT (1.0f / POLL_HZ)
+#define DEAD_BAND_DPS 0.5f
+#define MIN_CUTOFF_HZ 1.0f
+#define BETA 0.05f
+#define PIXELS_PER_DEGREE 10.0f
+
+// Synthetic yaw rate trace shaped like a hand held aim: holding still with
+// sensor noise and tremor, a quick flick, settling, then a slow pan.
+struct GyroTrace {
+    std::vector<float> yaw_dps;
+    size_t hold_end, flick_end, settle_end;
+};
+
+static GyroTrace make_trace() {
+    GyroTrace trace;
+    std::mt19937 rng(99);
+    std::normal_distribution<float> noise(0, 0.15f);
+    auto tremor = [&](size_t i) {
+        return 0.3f * std::sin(2 * (float)M_PI * 9.0f * i * DT) + noise(rng);
+    };
+
+    for (size_t i = 0; i < POLL_HZ; i++) {
+        trace.yaw_dps.push_back(tremor(i));
+    }
+    trace.hold_end = trace.yaw_dps.size();
+
+    // Close to 40 degrees in 150 ms, with a short ramp up and down
+    for (size_t i = 0; i < POLL_HZ * 15 / 100; i++) {
+        float phase = (float)i / (POLL_HZ * 15 / 100);
+        float envelope = std::min(1.0f, std::min(phase, 1 - phase) * 8);
+        trace.yaw_dps.push_back(300 * envelope + tremor(i));
+    }
+    trace.flick_end = trace.yaw_dps.size();
+
+    for (size_t i = 0; i < POLL_HZ / 2; i++) {
+        trace.yaw_dps.push_back(tremor(i));
+    }
+    trace.settle_end = trace.yaw_dps.size();
+
+    // Two seconds panning at 4 deg/s
+    for (size_t i = 0; i < POLL_HZ * 2; i++) {
+        trace.yaw_dps.push_back(4.0f + tremor(i));
+    }
+    return trace;
+}
+
+static void test_low_pass_step_response() {
+    LowPassFilter filter;
+    CHECK_NEAR(filter.filter(5, DT, 10), 5, 1e-6);
+    filter.reset();
+    filter.filter(0, DT, 10);
+    // After one time constant a step has reached 1 - 1/e
+    int steps = (int)std::round(POLL_HZ / (2 * M_PI * 10));
+    float value = 0;
+    for (int i = 0; i < steps; i++) {
+        value = filter.filter(1, DT, 10);
+    }
+    CHECK_NEAR(value, 1 - std::exp(-1.0), 0.05);
+}
+
+static void test_one_euro_smooths_and_tracks() {
+    GyroTrace trace = make_trace();
+    OneEuroFilter filter(MIN_CUTOFF_HZ, BETA, 1.0f);
+
+    std::vector<float> out;
+    for (float value : trace.yaw_dps) {
+        out.push_back(filter.filter(value, DT));
+    }
+
+    // Holding still, the tremor is smoothed well below the dead band
+    float raw_peak = 0, filtered_peak = 0;
+    for (size_t i = POLL_HZ / 4; i < trace.hold_end; i++) {
+        raw_peak = std::max(raw_peak, std::fabs(trace.yaw_dps[i]));
+        filtered_peak = std::max(filtered_peak, std::fabs(out[i]));
+    }
+    CHECK(raw_peak > DEAD_BAND_DPS);
+    CHECK(filtered_peak < DEAD_BAND_DPS);
+
+    // The flick speeds the filter up, so it reaches 90% within 50 ms
+    size_t reached = trace.flick_end;
+    for (size_t i = trace.hold_end; i < trace.flick_end; i++) {
+        if (out[i] > 270) {
+            reached = i;
+            break;
+        }
+    }
+    CHECK(reached - trace.hold_end < POLL_HZ * 5 / 100);
+
+    // Once panning steadily the output has settled on the pan rate
+    for (size_t i = trace.yaw_dps.size() - POLL_HZ / 2;
+         i < trace.yaw_dps.size(); i++) {
+        CHECK_NEAR(out[i], 4.0, 0.5);
+    }
+}
+
+// Cursor movement in pixels for each phase of the trace
+static void play_trace(const GyroTrace &trace, float moved[4],
+                       size_t ratchet_from = SIZE_MAX,
+                       size_t ratchet_to = SIZE_MAX) {
+    GyroAim aim({PIXELS_PER_DEGREE, DEAD_BAND_DPS, MIN_CUTOFF_HZ, BETA});
+    const size_t ends[4] = {trace.hold_end, trace.flick_end, trace.settle_end,
+                            trace.yaw_dps.size()};
+    int phase = 0;
+    for (int i = 0; i < 4; i++) {
+        moved[i] = 0;
+    }
+    for (size_t i = 0; i < trace.yaw_dps.size(); i++) {
+        while (i >= ends[phase]) {
+            phase++;
+        }
+        int dx, dy;
+        bool ratchet = i >= ratchet_from && i < ratchet_to;
+        aim.update(trace.yaw_dps[i], 0, DT, ratchet, &dx, &dy);
+        CHECK_EQ(dy, 0);
+        moved[phase] += dx;
+    }
+}
+
+static void test_cursor_follows_trace() {
+    GyroTrace trace = make_trace();
+    float moved[4];
+    play_trace(trace, moved);
+
+    // No drift while holding still
+    CHECK_EQ(moved[0], 0);
+    // The cursor turns as far as the flick did, the lag only carries a
+    // little of it into the settling phase
+    float turned = 0;
+    for (size_t i = trace.hold_end; i < trace.flick_end; i++) {
+        turned += trace.yaw_dps[i] * DT;
+    }
+    float flick = moved[1] + moved[2];
+    CHECK_NEAR(flick, -turned * PIXELS_PER_DEGREE,
+               turned * PIXELS_PER_DEGREE * 0.03);
+    CHECK(std::fabs(moved[2]) < std::fabs(flick) * 0.05);
+    // A slow pan moves well under a pixel per poll, the remainder carries it.
+    // The dead band takes its share off the rate.
+    CHECK_NEAR(moved[3], -(4.0 - DEAD_BAND_DPS) * 2 * PIXELS_PER_DEGREE,
+               3);
+}
+
+static void test_ratchet_holds_cursor() {
+    GyroTrace trace = make_trace();
+    float moved[4];
+    play_trace(trace, moved, trace.hold_end, trace.flick_end);
+    // Turning while the ratchet is held does not move the cursor
+    CHECK_EQ(moved[1], 0);
+    CHECK(std::fabs(moved[2]) < 45 * PIXELS_PER_DEGREE * 0.1);
+    CHECK(moved[3] < 0);
+}
+
+int main() {
+    RUN_TEST(test_low_pass_step_response);
+    RUN_TEST(test_one_euro_smooths_and_tracks);
+    RUN_TEST(test_cursor_follows_trace);
+    RUN_TEST(test_ratchet_holds_cursor);
+    return TEST_RESULT();
+}
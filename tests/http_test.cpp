@@ -0,0 +1,257 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs http_request against keep-alive HTTPS stand-in hosts to check that
+// connections and TLS sessions are reused, and that a request the host
+// refused to take on kept state is tried again from scratch
+
+extern "C" {
+#include "errors.h"
+#include "http.h"
+}
+#include "test_common.hpp"
+#include "tls_identity.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+extern "C" {
+// Normally defined by client.c
+const char *gs_error = nullptr;
+}
+
+#define SERVERINFO_BODY "<root status_code=\"200\"/>"
+
+enum StandInBehavior {
+    // Answers every request on a connection and keeps it open
+    KEEP_ALIVE,
+    // Answers the first request on a connection, then closes it on the
+    // second without a reply, like a host that timed out the idle connection
+    DROP_KEPT,
+};
+
+static SSL_CTX *resume_ctx;
+static SSL_CTX *refuse_resume_ctx;
+
+class StandIn {
+  public:
+    StandIn(StandInBehavior behavior, SSL_CTX *ctx)
+        : behavior(behavior), ctx(ctx) {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(listen_fd, 8) != 0) {
+            perror("stand-in listen");
+            exit(1);
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd, (sockaddr *)&addr, &len);
+        bound_port = ntohs(addr.sin_port);
+        thread = std::thread(&StandIn::run, this);
+    }
+
+    ~StandIn() {
+        stopping = true;
+        shutdown(listen_fd, SHUT_RDWR);
+        thread.join();
+        close(listen_fd);
+    }
+
+    std::string url(const char *path) const {
+        return "https://127.0.0.1:" + std::to_string(bound_port) + path;
+    }
+
+    std::atomic<int> handshakes{0};
+    std::atomic<int> resumed{0};
+    std::atomic<int> requests{0};
+    std::atomic<int> replies{0};
+
+  private:
+    // Connections are served one at a time, the client only keeps one open
+    void run() {
+        while (!stopping) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            SSL *ssl = SSL_new(ctx);
+            SSL_set_fd(ssl, fd);
+            if (SSL_accept(ssl) == 1) {
+                handshakes++;
+                if (SSL_session_reused(ssl)) {
+                    resumed++;
+                }
+                serve_connection(ssl);
+            }
+            SSL_free(ssl);
+            close(fd);
+        }
+    }
+
+    void serve_connection(SSL *ssl) {
+        for (int served = 0;; served++) {
+            if (!read_request(ssl)) {
+                return;
+            }
+            requests++;
+            if (behavior == DROP_KEPT && served > 0) {
+                return;
+            }
+            std::string reply =
+                "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\n"
+                "Content-Length: " +
+                std::to_string(strlen(SERVERINFO_BODY)) +
+                "\r\n\r\n" SERVERINFO_BODY;
+            // Counted first, the client may check as soon as it has the reply
+            replies++;
+            SSL_write(ssl, reply.data(), reply.size());
+        }
+    }
+
+    // The client sends no bodies and never pipelines
+    static bool read_request(SSL *ssl) {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            int n = SSL_read(ssl, buffer, sizeof(buffer));
+            if (n <= 0) {
+                return false;
+            }
+            request.append(buffer, n);
+        }
+        return true;
+    }
+
+    StandInBehavior behavior;
+    SSL_CTX *ctx;
+    int listen_fd;
+    unsigned short bound_port;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+};
+
+static std::string key_dir;
+
+// Returns the status of http_request, and checks the body on success
+static int request(const std::string &url) {
+    PHTTP_DATA data = http_create_data();
+    int ret = http_request((char *)url.c_str(), data);
+    if (ret == GS_OK) {
+        CHECK(data->memory != nullptr &&
+              strcmp(data->memory, SERVERINFO_BODY) == 0);
+    }
+    http_free_data(data);
+    return ret;
+}
+
+static void test_kept_connection_reused() {
+    StandIn host(KEEP_ALIVE, resume_ctx);
+    CHECK_EQ(http_init(key_dir.c_str(), 0), GS_OK);
+
+    CHECK_EQ(request(host.url("/serverinfo?uniqueid=0")), GS_OK);
+    CHECK_EQ(request(host.url("/serverinfo?uniqueid=0")), GS_OK);
+    // Both requests went over the first connection
+    CHECK_EQ(host.handshakes, 1);
+    CHECK_EQ(host.requests, 2);
+
+    http_cleanup();
+}
+
+static void test_dropped_connection_resumes_session() {
+    StandIn host(DROP_KEPT, resume_ctx);
+    CHECK_EQ(http_init(key_dir.c_str(), 0), GS_OK);
+
+    CHECK_EQ(request(host.url("/serverinfo")), GS_OK);
+    // The request goes unanswered on the kept connection and is sent again
+    // on a new one, which picks up the TLS session of the first
+    CHECK_EQ(request(host.url("/serverinfo")), GS_OK);
+    CHECK_EQ(host.handshakes, 2);
+    CHECK_EQ(host.resumed, 1);
+    CHECK_EQ(host.requests, 3);
+    CHECK_EQ(host.replies, 2);
+
+    http_cleanup();
+}
+
+static void test_refused_session_retried() {
+    StandIn host(DROP_KEPT, refuse_resume_ctx);
+    CHECK_EQ(http_init(key_dir.c_str(), 0), GS_OK);
+
+    CHECK_EQ(request(host.url("/serverinfo")), GS_OK);
+    // The new connection fails its handshake on the resumed session, the
+    // second attempt starts over without any kept state
+    CHECK_EQ(request(host.url("/serverinfo")), GS_OK);
+    CHECK_EQ(host.handshakes, 2);
+    CHECK_EQ(host.resumed, 0);
+    CHECK_EQ(host.requests, 3);
+    CHECK_EQ(host.replies, 2);
+
+    http_cleanup();
+}
+
+static void test_abort() {
+    StandIn host(KEEP_ALIVE, resume_ctx);
+    CHECK_EQ(http_init(key_dir.c_str(), 0), GS_OK);
+
+    http_abort(true);
+    CHECK_EQ(request(host.url("/serverinfo")), GS_FAILED);
+    CHECK_EQ(host.replies, 0);
+    http_abort(false);
+    CHECK_EQ(request(host.url("/serverinfo")), GS_OK);
+
+    http_cleanup();
+}
+
+int main() {
+    char dir_template[] = "/tmp/http_test.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    key_dir = dir_template;
+    if (!write_identity(key_dir)) {
+        fprintf(stderr, "Could not write the client identity\n");
+        return 1;
+    }
+    resume_ctx = make_server_ctx(key_dir, false);
+    SSL_CTX_set_session_id_context(resume_ctx, (const unsigned char *)"http",
+                                   4);
+    // Without a session id context OpenSSL fails every resumed handshake
+    // with a client certificate, like a host that dropped its session cache
+    refuse_resume_ctx = make_server_ctx(key_dir, false);
+
+    RUN_TEST(test_kept_connection_reused);
+    RUN_TEST(test_dropped_connection_resumes_session);
+    RUN_TEST(test_refused_session_retried);
+    RUN_TEST(test_abort);
+
+    SSL_CTX_free(resume_ctx);
+    SSL_CTX_free(refuse_resume_ctx);
+    remove_identity(key_dir);
+    return TEST_RESULT();
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+extern "C" {
+#include "mkcert.h"
+}
+#include "test_common.hpp"
+
+#include <chrono>
+#include <string>
+
+struct KeyTypeInfo {
+    MKCERT_KEY_TYPE type;
+    const char *name;
+    int pkey_id;
+    int bits;
+};
+
+static const KeyTypeInfo KEY_TYPES[] = {
+    {MKCERT_KEY_RSA_2048, "rsa2048", EVP_PKEY_RSA, 2048},
+    {MKCERT_KEY_RSA_1024, "rsa1024", EVP_PKEY_RSA, 1024},
+    {MKCERT_KEY_EC_P256, "ecp256", EVP_PKEY_EC, 256},
+};
+
+static void count_candidates(int stage, int count, void *context) {
+    // Stage 0 is reported for every prime candidate tried, as the 3DS
+    // keygen screen counts them
+    if (stage == 0) {
+        (*(int *)context)++;
+    }
+}
+
+// Generates keys of one type and returns the mean time per key in ms
+static double time_keygen(const KeyTypeInfo &info, int keys, int *candidates) {
+    double total_ms = 0;
+    for (int i = 0; i < keys; i++) {
+        auto start = std::chrono::steady_clock::now();
+        CERT_KEY_PAIR cert =
+            mkcert_generate_key(info.type, count_candidates, candidates);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        total_ms += elapsed.count();
+
+        CHECK(cert.x509 != nullptr && cert.pkey != nullptr &&
+              cert.p12 != nullptr);
+        if (cert.pkey != nullptr) {
+            CHECK_EQ(EVP_PKEY_base_id(cert.pkey), info.pkey_id);
+            CHECK_EQ(EVP_PKEY_bits(cert.pkey), info.bits);
+        }
+        if (cert.x509 != nullptr && cert.pkey != nullptr) {
+            // Self-signed with the key it carries
+            CHECK_EQ(X509_verify(cert.x509, cert.pkey), 1);
+        }
+        mkcert_free(cert);
+    }
+    return total_ms / keys;
+}
+
+static void test_key_types() {
+    double mean_ms[3];
+    for (int i = 0; i < 3; i++) {
+        int candidates = 0;
+        int keys = KEY_TYPES[i].type == MKCERT_KEY_EC_P256 ? 10 : 3;
+        mean_ms[i] = time_keygen(KEY_TYPES[i], keys, &candidates);
+        printf("%s: %.1f ms per key, %.1f candidates per key\n",
+               KEY_TYPES[i].name, mean_ms[i], (double)candidates / keys);
+
+        if (KEY_TYPES[i].type == MKCERT_KEY_EC_P256) {
+            // Nothing to count, the keygen screen shows a plain spinner
+            CHECK_EQ(candidates, 0);
+        } else {
+            CHECK(candidates > 0);
+        }
+    }
+    // The reason the smaller key types are offered at all
+    CHECK(mean_ms[2] < mean_ms[0]);
+}
+
+static void bench() {
+    for (const KeyTypeInfo &info : KEY_TYPES) {
+        int candidates = 0;
+        int keys = info.type == MKCERT_KEY_EC_P256 ? 200 : 20;
+        double mean_ms = time_keygen(info, keys, &candidates);
+        printf("%s: %.2f ms per key over %d keys, %.1f candidates per key\n",
+               info.name, mean_ms, keys, (double)candidates / keys);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        bench();
+        return TEST_RESULT();
+    }
+
+    RUN_TEST(test_key_types);
+    return TEST_RESULT();
+}
@@ -0,0 +1,340 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs gs_probe_hosts against stand-in servers on loopback addresses, one
+// per way a host can answer
+
+extern "C" {
+#include "errors.h"
+#include "http.h"
+#include "probe.h"
+}
+#include "test_common.hpp"
+#include "tls_identity.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+// Normally defined by client.c and moonlight-common-c
+const char *gs_error = nullptr;
+
+uint64_t LiGetMillis(void) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+}
+
+#define PROBE_TIMEOUT_MS 1000
+#define CLIENT_UNIQUE_ID "5A1C2E4B7E3F0D1A"
+#define OTHER_UNIQUE_ID "FEDCBA9876543210"
+#define RUNNING_GAME 881448767
+
+enum StandInBehavior {
+    // Plain serverinfo over HTTP, pointing at the HTTPS stand-in
+    SERVE_HTTP,
+    // serverinfo over HTTPS, paired only with expected_id
+    SERVE_HTTPS,
+    // Fails the handshake on the client certificate, like GeForce Experience
+    REFUSE_HANDSHAKE,
+    // Takes the request, then answers it with an unauthorized status
+    REFUSE_REQUEST,
+    // Accepts the connection and never answers
+    HANG,
+};
+
+static SSL_CTX *serve_ctx;
+static SSL_CTX *refuse_ctx;
+
+class StandIn {
+  public:
+    StandIn(const char *address, unsigned short port, StandInBehavior behavior)
+        : behavior(behavior) {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, address, &addr.sin_addr);
+        if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(listen_fd, 8) != 0) {
+            perror("stand-in listen");
+            exit(1);
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd, (sockaddr *)&addr, &len);
+        bound_port = ntohs(addr.sin_port);
+        thread = std::thread(&StandIn::run, this);
+    }
+
+    ~StandIn() {
+        stopping = true;
+        shutdown(listen_fd, SHUT_RDWR);
+        thread.join();
+        close(listen_fd);
+        for (int fd : held) {
+            close(fd);
+        }
+    }
+
+    unsigned short port() const { return bound_port; }
+
+    // Set before the probe starts, read by the server thread
+    unsigned short https_port = 0;
+    std::string expected_id = CLIENT_UNIQUE_ID;
+    std::atomic<int> requests{0};
+
+  private:
+    void run() {
+        while (!stopping) {
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            if (behavior == HANG) {
+                held.push_back(fd);
+                continue;
+            }
+            if (behavior == SERVE_HTTP) {
+                serve_plain(fd);
+            } else {
+                serve_tls(fd);
+            }
+            close(fd);
+        }
+    }
+
+    static std::string read_request(int fd, SSL *ssl) {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            int n = ssl ? SSL_read(ssl, buffer, sizeof(buffer))
+                        : (int)recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            request.append(buffer, n);
+        }
+        return request;
+    }
+
+    static std::string query_value(const std::string &request,
+                                   const std::string &key) {
+        size_t start = request.find(key + "=");
+        if (start == std::string::npos) {
+            return "";
+        }
+        start += key.size() + 1;
+        size_t end = request.find_first_of("& ", start);
+        return request.substr(start, end - start);
+    }
+
+    std::string serverinfo(const std::string &request, bool https) {
+        bool paired = https && query_value(request, "uniqueid") == expected_id;
+        return "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+               "<root status_code=\"200\">"
+               "<HttpsPort>" +
+               std::to_string(https_port) +
+               "</HttpsPort>"
+               "<PairStatus>" +
+               std::string(paired ? "1" : "0") +
+               "</PairStatus>"
+               "<currentgame>" +
+               std::to_string(RUNNING_GAME) +
+               "</currentgame>"
+               "<state>SUNSHINE_SERVER_BUSY</state></root>";
+    }
+
+    static std::string response(const std::string &body) {
+        return "HTTP/1.1 200 OK\r\nContent-Type: application/xml\r\n"
+               "Content-Length: " +
+               std::to_string(body.size()) +
+               "\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    void serve_plain(int fd) {
+        std::string request = read_request(fd, nullptr);
+        requests++;
+        std::string reply = response(serverinfo(request, false));
+        send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+    }
+
+    void serve_tls(int fd) {
+        SSL *ssl =
+            SSL_new(behavior == REFUSE_HANDSHAKE ? refuse_ctx : serve_ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_accept(ssl) == 1) {
+            std::string request = read_request(fd, ssl);
+            requests++;
+            std::string reply =
+                behavior == REFUSE_REQUEST
+                    ? response("<root status_code=\"401\" "
+                               "status_message=\"The client is not "
+                               "authorized.\"/>")
+                    : response(serverinfo(request, true));
+            SSL_write(ssl, reply.data(), reply.size());
+            SSL_shutdown(ssl);
+        }
+        SSL_free(ssl);
+    }
+
+    StandInBehavior behavior;
+    int listen_fd;
+    unsigned short bound_port;
+    std::atomic<bool> stopping{false};
+    std::vector<int> held;
+    std::thread thread;
+};
+
+struct ProbeReport {
+    int calls = 0;
+    int status = GS_OK;
+    PROBE_PAIRING pairing = PROBE_PAIRING_UNKNOWN;
+    int current_game = 0;
+    uint64_t at_ms = 0;
+};
+
+struct ProbeRun {
+    uint64_t start_ms;
+    std::vector<ProbeReport> reports;
+};
+
+static void record_result(const PROBE_RESULT *result, void *context) {
+    ProbeRun *run = (ProbeRun *)context;
+    ProbeReport &report = run->reports[result->index];
+    report.calls++;
+    report.status = result->status;
+    report.pairing = result->pairing;
+    report.current_game = result->currentGame;
+    report.at_ms = LiGetMillis() - run->start_ms;
+}
+
+static std::string key_dir;
+
+static void test_stand_in_hosts() {
+    // Every host shares the HTTP port, like GameStream hosts do
+    StandIn paired_http("127.0.0.2", 0, SERVE_HTTP);
+    unsigned short http_port = paired_http.port();
+    StandIn paired_https("127.0.0.2", 0, SERVE_HTTPS);
+    paired_http.https_port = paired_https.port();
+
+    // Paired, but with another client identity
+    StandIn other_http("127.0.0.3", http_port, SERVE_HTTP);
+    StandIn other_https("127.0.0.3", 0, SERVE_HTTPS);
+    other_https.expected_id = OTHER_UNIQUE_ID;
+    other_http.https_port = other_https.port();
+
+    StandIn handshake_http("127.0.0.4", http_port, SERVE_HTTP);
+    StandIn handshake_https("127.0.0.4", 0, REFUSE_HANDSHAKE);
+    handshake_http.https_port = handshake_https.port();
+
+    StandIn request_http("127.0.0.5", http_port, SERVE_HTTP);
+    StandIn request_https("127.0.0.5", 0, REFUSE_REQUEST);
+    request_http.https_port = request_https.port();
+
+    // Answers over HTTP, but HTTPS runs into the deadline
+    StandIn slow_http("127.0.0.6", http_port, SERVE_HTTP);
+    StandIn slow_https("127.0.0.6", 0, HANG);
+    slow_http.https_port = slow_https.port();
+
+    StandIn late_http("127.0.0.7", http_port, HANG);
+
+    // 127.0.0.8 has nothing listening
+    const char *addresses[] = {"127.0.0.2", "127.0.0.3", "127.0.0.4",
+                               "127.0.0.5", "127.0.0.6", "127.0.0.7",
+                               "127.0.0.8"};
+    const int count = sizeof(addresses) / sizeof(addresses[0]);
+
+    ProbeRun run;
+    run.reports.resize(count);
+    run.start_ms = LiGetMillis();
+    int ret = gs_probe_hosts(addresses, count, http_port, key_dir.c_str(),
+                             CLIENT_UNIQUE_ID, PROBE_TIMEOUT_MS,
+                             record_result, &run);
+    uint64_t elapsed = LiGetMillis() - run.start_ms;
+    CHECK_EQ(ret, GS_OK);
+    CHECK(elapsed < PROBE_TIMEOUT_MS + 300);
+
+    for (const ProbeReport &report : run.reports) {
+        CHECK_EQ(report.calls, 1);
+    }
+
+    const ProbeReport &paired = run.reports[0];
+    CHECK_EQ(paired.status, GS_OK);
+    CHECK_EQ(paired.pairing, PROBE_PAIRED);
+    CHECK_EQ(paired.current_game, RUNNING_GAME);
+    // Settled hosts are reported right away, not at the deadline
+    CHECK(paired.at_ms < PROBE_TIMEOUT_MS / 2);
+    CHECK_EQ(paired_https.requests, 1);
+
+    CHECK_EQ(run.reports[1].status, GS_OK);
+    CHECK_EQ(run.reports[1].pairing, PROBE_NOT_PAIRED);
+
+    CHECK_EQ(run.reports[2].status, GS_OK);
+    CHECK_EQ(run.reports[2].pairing, PROBE_NOT_PAIRED);
+    CHECK_EQ(handshake_https.requests, 0);
+
+    CHECK_EQ(run.reports[3].status, GS_OK);
+    CHECK_EQ(run.reports[3].pairing, PROBE_NOT_PAIRED);
+    CHECK_EQ(request_https.requests, 1);
+
+    // Running out of time over HTTPS says nothing about pairing
+    CHECK_EQ(run.reports[4].status, GS_OK);
+    CHECK_EQ(run.reports[4].pairing, PROBE_PAIRING_UNKNOWN);
+    CHECK_EQ(run.reports[4].current_game, RUNNING_GAME);
+
+    CHECK_EQ(run.reports[5].status, GS_IO_ERROR);
+    CHECK(run.reports[5].at_ms >= PROBE_TIMEOUT_MS - 50);
+
+    CHECK_EQ(run.reports[6].status, GS_IO_ERROR);
+    CHECK(run.reports[6].at_ms < PROBE_TIMEOUT_MS / 2);
+}
+
+int main() {
+    char dir_template[] = "/tmp/probe_test.XXXXXX";
+    if (mkdtemp(dir_template) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    key_dir = dir_template;
+    if (!write_identity(key_dir)) {
+        fprintf(stderr, "Could not write the client identity\n");
+        return 1;
+    }
+    serve_ctx = make_server_ctx(key_dir, false);
+    refuse_ctx = make_server_ctx(key_dir, true);
+
+    RUN_TEST(test_stand_in_hosts);
+
+    SSL_CTX_free(serve_ctx);
+    SSL_CTX_free(refuse_ctx);
+    remove_identity(key_dir);
+    return TEST_RESULT();
+}
@@ -0,0 +1,143 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio/n3ds/SpscRing.hpp"
+#include "test_common.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Shaped like an audio packet, so a torn read shows up as a bad checksum
+struct TestPacket {
+    uint64_t seq;
+    uint32_t payload[60];
+    uint64_t checksum;
+};
+
+static void fill_packet(TestPacket *packet, uint64_t seq) {
+    packet->seq = seq;
+    packet->checksum = seq;
+    for (uint32_t i = 0; i < 60; i++) {
+        packet->payload[i] = (uint32_t)(seq * 2654435761u + i);
+        packet->checksum += packet->payload[i];
+    }
+}
+
+static bool packet_valid(const TestPacket *packet) {
+    uint64_t checksum = packet->seq;
+    for (uint32_t i = 0; i < 60; i++) {
+        checksum += packet->payload[i];
+    }
+    return checksum == packet->checksum;
+}
+
+static void test_capacity_rounds_up() {
+    CHECK_EQ(SpscRing<int>(1).capacity(), 1);
+    CHECK_EQ(SpscRing<int>(5).capacity(), 8);
+    CHECK_EQ(SpscRing<int>(16).capacity(), 16);
+}
+
+static void test_full_and_empty() {
+    SpscRing<int> ring(4);
+    CHECK(ring.begin_read() == nullptr);
+
+    for (int i = 0; i < 4; i++) {
+        int *slot = ring.begin_write();
+        CHECK(slot != nullptr);
+        if (slot) {
+            *slot = i;
+            ring.end_write();
+        }
+    }
+    CHECK(ring.begin_write() == nullptr);
+
+    for (int i = 0; i < 4; i++) {
+        int *slot = ring.begin_read();
+        CHECK(slot != nullptr);
+        if (slot) {
+            CHECK_EQ(*slot, i);
+            ring.end_read();
+        }
+    }
+    CHECK(ring.begin_read() == nullptr);
+    CHECK(ring.begin_write() != nullptr);
+}
+
+// Runs a producer and a consumer flat out, checking that every item arrives
+// once, in order and intact. Returns items per second.
+static double stress(size_t capacity, uint64_t items) {
+    SpscRing<TestPacket> ring(capacity);
+    uint64_t bad = 0, out_of_order = 0, received = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&] {
+        uint64_t expected = 0;
+        while (expected < items) {
+            TestPacket *packet = ring.begin_read();
+            if (packet == nullptr) {
+                std::this_thread::yield();
+                continue;
+            }
+            bad += !packet_valid(packet);
+            out_of_order += packet->seq != expected;
+            expected = packet->seq + 1;
+            received++;
+            ring.end_read();
+        }
+    });
+
+    for (uint64_t seq = 0; seq < items;) {
+        TestPacket *packet = ring.begin_write();
+        if (packet == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        fill_packet(packet, seq++);
+        ring.end_write();
+    }
+    consumer.join();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    CHECK_EQ(bad, 0);
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(received, items);
+    return items / elapsed.count();
+}
+
+static void test_stress_small_ring() { stress(2, 200000); }
+
+static void test_stress_audio_ring() { stress(32, 1000000); }
+
+int main(int argc, char **argv) {
+    // With --bench, report the throughput instead of just checking it
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        for (size_t capacity : {2, 8, 32, 128}) {
+            printf("capacity %3zu: %.2f M packets/s\n", capacity,
+                   stress(capacity, 5000000) / 1e6);
+        }
+        return TEST_RESULT();
+    }
+
+    RUN_TEST(test_capacity_rounds_up);
+    RUN_TEST(test_full_and_empty);
+    RUN_TEST(test_stress_small_ring);
+    RUN_TEST(test_stress_audio_ring);
+    return TEST_RESULT();
+}
@@ -0,0 +1,154 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "audio/n3ds/StereoDownmix.hpp"
+#include "test_common.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Output for one frame with a single channel set to value
+static void downmix_one(int channels, int channel, int16_t value,
+                        int16_t out[2]) {
+    std::vector<int16_t> in(channels, 0);
+    in[channel] = value;
+    downmix_to_stereo(in.data(), channels, 1, out);
+}
+
+static void test_channel_gains() {
+    const double front = 1 / (1 + 0.7071);
+    const double surround = 0.7071 / (1 + 0.7071);
+    int16_t out[2];
+
+    for (int channels : {6, 8}) {
+        downmix_one(channels, 0, 10000, out);
+        CHECK_NEAR(out[0], 10000 * front, 2);
+        CHECK_EQ(out[1], 0);
+
+        downmix_one(channels, 1, 10000, out);
+        CHECK_EQ(out[0], 0);
+        CHECK_NEAR(out[1], 10000 * front, 2);
+
+        // Centre goes to both sides at -3 dB relative to the fronts
+        downmix_one(channels, 2, 10000, out);
+        CHECK_NEAR(out[0], 10000 * surround, 2);
+        CHECK_EQ(out[0], out[1]);
+
+        // LFE is dropped
+        downmix_one(channels, 3, 10000, out);
+        CHECK_EQ(out[0], 0);
+        CHECK_EQ(out[1], 0);
+
+        downmix_one(channels, 4, 10000, out);
+        CHECK_NEAR(out[0], 10000 * surround, 2);
+        CHECK_EQ(out[1], 0);
+
+        downmix_one(channels, 5, -10000, out);
+        CHECK_EQ(out[0], 0);
+        CHECK_NEAR(out[1], -10000 * surround, 2);
+    }
+
+    // The 7.1 side pair folds into the same sides as the rears
+    downmix_one(8, 6, 10000, out);
+    CHECK_NEAR(out[0], 10000 * surround, 2);
+    CHECK_EQ(out[1], 0);
+    downmix_one(8, 7, 10000, out);
+    CHECK_EQ(out[0], 0);
+    CHECK_NEAR(out[1], 10000 * surround, 2);
+}
+
+static void test_other_layouts_keep_front_pair() {
+    int16_t out[2];
+    downmix_one(2, 0, 10000, out);
+    CHECK_NEAR(out[0], 10000 / (1 + 0.7071), 2);
+    downmix_one(4, 2, 10000, out);
+    CHECK_EQ(out[0], 0);
+    CHECK_EQ(out[1], 0);
+}
+
+static void test_saturates_instead_of_wrapping() {
+    for (int channels : {6, 8}) {
+        std::vector<int16_t> in(channels, INT16_MAX);
+        int16_t out[2];
+        downmix_to_stereo(in.data(), channels, 1, out);
+        CHECK_EQ(out[0], INT16_MAX);
+        CHECK_EQ(out[1], INT16_MAX);
+
+        in.assign(channels, INT16_MIN);
+        downmix_to_stereo(in.data(), channels, 1, out);
+        CHECK_EQ(out[0], INT16_MIN);
+        CHECK_EQ(out[1], INT16_MIN);
+    }
+
+    // A full scale front channel alone stays below clipping
+    int16_t out[2];
+    downmix_one(8, 0, INT16_MAX, out);
+    CHECK(out[0] < INT16_MAX);
+    CHECK(out[0] > 0);
+}
+
+static void test_frames_stride() {
+    // Three 5.1 frames, each only carrying its own index on the front left
+    std::vector<int16_t> in(3 * 6, 0);
+    for (int i = 0; i < 3; i++) {
+        in[i * 6] = (int16_t)(1000 * (i + 1));
+    }
+    int16_t out[6];
+    downmix_to_stereo(in.data(), 6, 3, out);
+    for (int i = 0; i < 3; i++) {
+        CHECK_NEAR(out[i * 2], 1000 * (i + 1) / (1 + 0.7071), 2);
+        CHECK_EQ(out[i * 2 + 1], 0);
+    }
+}
+
+static void bench() {
+    // One 5 ms Opus frame at 48 kHz
+    const int frames = 240;
+    for (int channels : {6, 8}) {
+        std::vector<int16_t> in(frames * channels);
+        for (size_t i = 0; i < in.size(); i++) {
+            in[i] = (int16_t)(i * 7919);
+        }
+        std::vector<int16_t> out(frames * 2);
+        const int iterations = 200000;
+        // Summing the output keeps the calls from being optimised out
+        volatile int sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            downmix_to_stereo(in.data(), channels, frames, out.data());
+            sink = sink + out[i % (frames * 2)];
+        }
+        std::chrono::duration<double, std::nano> elapsed =
+            std::chrono::steady_clock::now() - start;
+        printf("%d channels: %.1f ns per 5 ms frame\n", channels,
+               elapsed.count() / iterations);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        bench();
+        return 0;
+    }
+
+    RUN_TEST(test_channel_gains);
+    RUN_TEST(test_other_layouts_keep_front_pair);
+    RUN_TEST(test_saturates_instead_of_wrapping);
+    RUN_TEST(test_frames_stride);
+    return TEST_RESULT();
+}
@@ -0,0 +1,128 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input/n3ds/StickTransform.hpp"
+#include "test_common.hpp"
+
+#include <climits>
+
+// Circle pad range used by n3ds_input.cpp before calibration
+#define RANGE 150
+
+static short out_x(const StickTransform &stick, int x, int y = 0) {
+    short ox, oy;
+    stick.apply(x, y, &ox, &oy);
+    return ox;
+}
+
+static short out_y(const StickTransform &stick, int x, int y) {
+    short ox, oy;
+    stick.apply(x, y, &ox, &oy);
+    return oy;
+}
+
+static void test_linear_default() {
+    StickTransform stick({RANGE, 0, 0, 0, 100});
+    CHECK_EQ(out_x(stick, 0), 0);
+    CHECK_EQ(out_x(stick, RANGE), SHRT_MAX);
+    CHECK_EQ(out_x(stick, -RANGE), -SHRT_MAX);
+    CHECK_NEAR(out_x(stick, RANGE / 2), SHRT_MAX / 2, SHRT_MAX * 0.01);
+    CHECK_NEAR(out_x(stick, 1), SHRT_MAX / RANGE, 2);
+    CHECK_NEAR(out_y(stick, 0, -RANGE / 3), -SHRT_MAX / 3, SHRT_MAX * 0.01);
+}
+
+static void test_full_range_clamped() {
+    StickTransform stick({RANGE, 10, 0, 0, 150});
+    // Readings past the calibrated range saturate instead of wrapping
+    CHECK_EQ(out_x(stick, RANGE + 20), SHRT_MAX);
+    CHECK_EQ(out_x(stick, -RANGE - 20), -SHRT_MAX);
+    short x, y;
+    stick.apply(RANGE, RANGE, &x, &y);
+    CHECK(x > 0 && y > 0);
+    CHECK_EQ(x, y);
+    // Diagonals are scaled on the radius, so they don't exceed full range
+    CHECK_NEAR(x, SHRT_MAX * 0.7071, SHRT_MAX * 0.02);
+}
+
+static void test_radial_deadzone() {
+    // 10% of 150
+    StickTransform stick({RANGE, 10, 0, 0, 100});
+    CHECK_EQ(out_x(stick, 14), 0);
+    CHECK_EQ(out_x(stick, 10, 10), 0);
+    CHECK(out_x(stick, 17) > 0);
+    CHECK(out_x(stick, 17) < SHRT_MAX * 0.03);
+    // Travel is rescaled so full deflection is still reached
+    CHECK_EQ(out_x(stick, RANGE), SHRT_MAX);
+}
+
+static void test_axial_deadzone() {
+    StickTransform stick({RANGE, 0, 10, 0, 100});
+    // Within 15 of an axis the other axis reads exactly zero
+    CHECK_EQ(out_y(stick, RANGE, 14), 0);
+    CHECK(out_y(stick, RANGE, 16) > 0);
+    CHECK_EQ(out_x(stick, -12, RANGE), 0);
+}
+
+static void test_anti_deadzone() {
+    StickTransform stick({RANGE, 10, 0, 20, 100});
+    CHECK_EQ(out_x(stick, 14), 0);
+    // The first reading past the deadzone jumps to 20% of full range
+    short first = out_x(stick, 16);
+    CHECK(first >= SHRT_MAX * 0.2);
+    CHECK(first < SHRT_MAX * 0.23);
+    CHECK_EQ(out_x(stick, RANGE), SHRT_MAX);
+}
+
+static void test_response_curve() {
+    StickTransform stick({RANGE, 0, 0, 0, 200});
+    // Squared response, half deflection gives a quarter of the output
+    CHECK_NEAR(out_x(stick, RANGE / 2), SHRT_MAX / 4, SHRT_MAX * 0.01);
+    CHECK_EQ(out_x(stick, RANGE), SHRT_MAX);
+}
+
+// The gain is stepped per table slice, so a flat part of a curve can dip by
+// a few counts where one slice hands over to the next
+#define STICK_STEP_TOLERANCE (SHRT_MAX / 200)
+
+static void test_monotonic_and_symmetric() {
+    const StickProfile profiles[] = {{RANGE, 0, 0, 0, 100},
+                                     {RANGE, 15, 5, 25, 250},
+                                     {100, 5, 0, 0, 50}};
+    for (const StickProfile &profile : profiles) {
+        StickTransform stick(profile);
+        CHECK_EQ(out_x(stick, profile.range), SHRT_MAX);
+        CHECK_EQ(out_y(stick, 0, -profile.range), -SHRT_MAX);
+        short previous = 0;
+        for (int x = 0; x <= profile.range * 3 / 2; x++) {
+            short value = out_x(stick, x);
+            CHECK(value >= previous - STICK_STEP_TOLERANCE);
+            CHECK_EQ(out_x(stick, -x), -value);
+            previous = value;
+        }
+    }
+}
+
+int main() {
+    RUN_TEST(test_linear_default);
+    RUN_TEST(test_full_range_clamped);
+    RUN_TEST(test_radial_deadzone);
+    RUN_TEST(test_axial_deadzone);
+    RUN_TEST(test_anti_deadzone);
+    RUN_TEST(test_response_curve);
+    RUN_TEST(test_monotonic_and_symmetric);
+    return TEST_RESULT();
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Minimal checks for the host tests, a failed check is reported and the
+// test keeps going so one run shows every failure.
+
+#include <cmath>
+#include <cstdio>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,   \
+                    #cond);                                                    \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+    do {                                                                       \
+        long long check_a = (long long)(a);                                    \
+        long long check_b = (long long)(b);                                    \
+        if (check_a != check_b) {                                              \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",  \
+                    __FILE__, __LINE__, #a, #b, check_a, check_b);             \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_NEAR(a, b, eps)                                                  \
+    do {                                                                       \
+        double check_a = (double)(a);                                          \
+        double check_b = (double)(b);                                          \
+        if (std::fabs(check_a - check_b) > (eps)) {                            \
+            fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %g != %g\n",    \
+                    __FILE__, __LINE__, #a, #b, check_a, check_b);             \
+            test_failures++;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define RUN_TEST(fn)                                                           \
+    do {                                                                       \
+        int failures_before = test_failures;                                   \
+        fn();                                                                  \
+        printf("%s %s\n", failures_before == test_failures ? "PASS" : "FAIL", \
+               #fn);                                                           \
+    } while (0)
+
+#define TEST_RESULT() (test_failures == 0 ? 0 : 1)
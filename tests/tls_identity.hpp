@@ -0,0 +1,94 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Client identity and server contexts for the tests that talk HTTPS to
+// stand-in hosts. The stand-ins reuse the client's certificate as their own.
+
+extern "C" {
+#include "http.h"
+}
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+// Writes a self-signed certificate the same way the client keeps its own
+static bool write_identity(const std::string &dir) {
+    EVP_PKEY *key = EVP_RSA_gen(2048);
+    X509 *cert = X509_new();
+    if (key == nullptr || cert == nullptr) {
+        return false;
+    }
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 60 * 60);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char *)"NVIDIA GameStream Client",
+                               -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_set_pubkey(cert, key);
+    X509_sign(cert, key, EVP_sha256());
+
+    FILE *cert_file = fopen((dir + "/" CERTIFICATE_FILE_NAME).c_str(), "w");
+    FILE *key_file = fopen((dir + "/" KEY_FILE_NAME).c_str(), "w");
+    bool ok = cert_file && key_file && PEM_write_X509(cert_file, cert) &&
+              PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr,
+                                   nullptr);
+    if (cert_file) {
+        fclose(cert_file);
+    }
+    if (key_file) {
+        fclose(key_file);
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+static void remove_identity(const std::string &dir) {
+    unlink((dir + "/" CERTIFICATE_FILE_NAME).c_str());
+    unlink((dir + "/" KEY_FILE_NAME).c_str());
+    rmdir(dir.c_str());
+}
+
+static int accept_any_client(int, X509_STORE_CTX *) { return 1; }
+static int refuse_any_client(int, X509_STORE_CTX *) { return 0; }
+
+static SSL_CTX *make_server_ctx(const std::string &dir, bool refuse) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate_file(
+        ctx, (dir + "/" CERTIFICATE_FILE_NAME).c_str(), SSL_FILETYPE_PEM);
+    SSL_CTX_use_PrivateKey_file(ctx, (dir + "/" KEY_FILE_NAME).c_str(),
+                                SSL_FILETYPE_PEM);
+    // The client has to present its certificate for every request
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
+                       refuse ? refuse_any_client : accept_any_client);
+    if (refuse) {
+        // Under TLS 1.2 the refusal lands inside the client's handshake
+        SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+    return ctx;
+}
@@ -0,0 +1,313 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+extern "C" {
+#include "errors.h"
+#include "xml.h"
+}
+#include "test_common.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Normally defined by client.c
+extern "C" {
+const char *gs_error = nullptr;
+}
+
+// serverinfo as returned by Sunshine over HTTPS, unique IDs replaced
+static const char SUNSHINE_SERVERINFO[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<root status_code=\"200\">"
+    "<hostname>DESKTOP-GAMING</hostname>"
+    "<appversion>7.1.431.-1</appversion>"
+    "<GfeVersion>3.23.0.74</GfeVersion>"
+    "<uniqueid>5A1C2E4B-7E3F-0D1A-9B8C-6F5E4D3C2B1A</uniqueid>"
+    "<HttpsPort>47984</HttpsPort>"
+    "<ExternalPort>47989</ExternalPort>"
+    "<MaxLumaPixelsHEVC>1869449984</MaxLumaPixelsHEVC>"
+    "<mac>00:00:00:00:00:00</mac>"
+    "<LocalIP>192.168.1.20</LocalIP>"
+    "<ServerCodecModeSupport>3843</ServerCodecModeSupport>"
+    "<SupportedDisplayMode>"
+    "<DisplayMode><Width>1920</Width><Height>1080</Height>"
+    "<RefreshRate>60</RefreshRate></DisplayMode>"
+    "<DisplayMode><Width>1280</Width><Height>720</Height>"
+    "<RefreshRate>120</RefreshRate></DisplayMode>"
+    "</SupportedDisplayMode>"
+    "<PairStatus>1</PairStatus>"
+    "<currentgame>881448767</currentgame>"
+    "<state>SUNSHINE_SERVER_BUSY</state>"
+    "</root>";
+
+// serverinfo from GeForce Experience over plain HTTP, unpaired. The entity
+// splits the GPU name across several character data callbacks
+static const char GFE_SERVERINFO[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-16\"?>\n"
+    "<root protocol_version=\"0.1\" query=\"serverinfo\" "
+    "status_code=\"200\" status_message=\"OK\">\n"
+    "  <hostname>LIVINGROOM</hostname>\n"
+    "  <appversion>7.1.450.0</appversion>\n"
+    "  <GfeVersion>3.27.0.120</GfeVersion>\n"
+    "  <uniqueid>0123456789ABCDEF</uniqueid>\n"
+    "  <HttpsPort>47984</HttpsPort>\n"
+    "  <gputype>NVIDIA GeForce RTX 3070 &amp; co</gputype>\n"
+    "  <GsVersion>7.1.450.0</GsVersion>\n"
+    "  <PairStatus>0</PairStatus>\n"
+    "  <currentgame>0</currentgame>\n"
+    "  <state>MJOLNIR_STATE_SERVER_AVAILABLE</state>\n"
+    "</root>\n";
+
+static const char UNAUTHORIZED_SERVERINFO[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<root status_code=\"401\" status_message=\"The client is not "
+    "authorized. Certificate verification failed.\"/>";
+
+static const char SUNSHINE_APPLIST[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<root status_code=\"200\">"
+    "<App><IsHdrSupported>0</IsHdrSupported>"
+    "<AppTitle>Desktop</AppTitle><ID>881448767</ID></App>"
+    "<App><IsHdrSupported>1</IsHdrSupported>"
+    "<AppTitle>Steam Big Picture</AppTitle><ID>1093255277</ID></App>"
+    "</root>";
+
+static const char *SERVERINFO_NODES[] = {
+    "currentgame", "PairStatus", "appversion", "state",
+    "ServerCodecModeSupport", "gputype", "GsVersion", "GfeVersion",
+    "HttpsPort", "uniqueid",
+};
+static const int SERVERINFO_FIELD_COUNT =
+    sizeof(SERVERINFO_NODES) / sizeof(SERVERINFO_NODES[0]);
+
+struct ServerInfoResult {
+    std::vector<char *> values;
+    PDISPLAY_MODE modes = nullptr;
+
+    ServerInfoResult() : values(SERVERINFO_FIELD_COUNT, nullptr) {}
+    ~ServerInfoResult() {
+        for (char *value : values) {
+            free(value);
+        }
+        free_modes(modes);
+    }
+
+    static void free_modes(PDISPLAY_MODE mode) {
+        while (mode != nullptr) {
+            PDISPLAY_MODE next = mode->next;
+            free(mode);
+            mode = next;
+        }
+    }
+};
+
+// The same field list client.c passes for serverinfo
+static int search_serverinfo(const char *xml, ServerInfoResult &result) {
+    XML_FIELD fields[SERVERINFO_FIELD_COUNT];
+    for (int i = 0; i < SERVERINFO_FIELD_COUNT; i++) {
+        fields[i].node = SERVERINFO_NODES[i];
+        fields[i].result = &result.values[i];
+    }
+    return xml_search_fields((char *)xml, strlen(xml), fields,
+                             SERVERINFO_FIELD_COUNT, &result.modes);
+}
+
+static std::string search_one(const char *xml, const char *node) {
+    char *value = nullptr;
+    if (xml_search((char *)xml, strlen(xml), (char *)node, &value) != GS_OK) {
+        return "<error>";
+    }
+    std::string copy = value;
+    free(value);
+    return copy;
+}
+
+// Every field must match what the per field parse returns for it
+static void check_matches_xml_search(const char *xml) {
+    ServerInfoResult result;
+    CHECK_EQ(search_serverinfo(xml, result), GS_OK);
+    for (int i = 0; i < SERVERINFO_FIELD_COUNT; i++) {
+        CHECK(result.values[i] != nullptr);
+        if (result.values[i] == nullptr) {
+            continue;
+        }
+        std::string expected = search_one(xml, SERVERINFO_NODES[i]);
+        if (expected != result.values[i]) {
+            fprintf(stderr, "%s: '%s' != '%s'\n", SERVERINFO_NODES[i],
+                    result.values[i], expected.c_str());
+            test_failures++;
+        }
+    }
+
+    PDISPLAY_MODE expected_modes = nullptr;
+    CHECK_EQ(xml_modelist((char *)xml, strlen(xml), &expected_modes), GS_OK);
+    PDISPLAY_MODE mode = result.modes;
+    PDISPLAY_MODE expected = expected_modes;
+    while (mode != nullptr && expected != nullptr) {
+        CHECK_EQ(mode->width, expected->width);
+        CHECK_EQ(mode->height, expected->height);
+        CHECK_EQ(mode->refresh, expected->refresh);
+        mode = mode->next;
+        expected = expected->next;
+    }
+    CHECK(mode == nullptr && expected == nullptr);
+    ServerInfoResult::free_modes(expected_modes);
+}
+
+static void test_sunshine_serverinfo() {
+    check_matches_xml_search(SUNSHINE_SERVERINFO);
+
+    ServerInfoResult result;
+    CHECK_EQ(search_serverinfo(SUNSHINE_SERVERINFO, result), GS_OK);
+    CHECK(std::string(result.values[0]) == "881448767");
+    CHECK(std::string(result.values[1]) == "1");
+    CHECK(std::string(result.values[3]) == "SUNSHINE_SERVER_BUSY");
+    CHECK(std::string(result.values[4]) == "3843");
+    // Missing fields come back empty, not NULL, like xml_search
+    CHECK(std::string(result.values[5]) == "");
+    CHECK(std::string(result.values[9]) ==
+          "5A1C2E4B-7E3F-0D1A-9B8C-6F5E4D3C2B1A");
+
+    int modes = 0;
+    bool found_720p120 = false;
+    for (PDISPLAY_MODE mode = result.modes; mode; mode = mode->next) {
+        modes++;
+        found_720p120 |= mode->width == 1280 && mode->height == 720 &&
+                         mode->refresh == 120;
+    }
+    CHECK_EQ(modes, 2);
+    CHECK(found_720p120);
+}
+
+static void test_gfe_serverinfo() {
+    check_matches_xml_search(GFE_SERVERINFO);
+
+    ServerInfoResult result;
+    CHECK_EQ(search_serverinfo(GFE_SERVERINFO, result), GS_OK);
+    CHECK(std::string(result.values[1]) == "0");
+    CHECK(std::string(result.values[5]) == "NVIDIA GeForce RTX 3070 & co");
+    CHECK(std::string(result.values[8]) == "47984");
+    CHECK(result.modes == nullptr);
+}
+
+static void test_unauthorized_leaves_results_untouched() {
+    ServerInfoResult result;
+    CHECK_EQ(search_serverinfo(UNAUTHORIZED_SERVERINFO, result), GS_ERROR);
+    for (char *value : result.values) {
+        CHECK(value == nullptr);
+    }
+    CHECK(result.modes == nullptr);
+    CHECK(gs_error != nullptr &&
+          strstr(gs_error, "not authorized") != nullptr);
+    free((void *)gs_error);
+    gs_error = nullptr;
+}
+
+static void test_malformed_is_invalid() {
+    // A reply cut short by a dropped connection
+    std::string truncated(SUNSHINE_SERVERINFO, sizeof(SUNSHINE_SERVERINFO) / 2);
+    ServerInfoResult result;
+    CHECK_EQ(search_serverinfo(truncated.c_str(), result), GS_INVALID);
+    for (char *value : result.values) {
+        CHECK(value == nullptr);
+    }
+    CHECK(result.modes == nullptr);
+}
+
+static void test_too_many_fields() {
+    XML_FIELD fields[17];
+    char *values[17] = {};
+    for (int i = 0; i < 17; i++) {
+        fields[i].node = "state";
+        fields[i].result = &values[i];
+    }
+    CHECK_EQ(xml_search_fields((char *)SUNSHINE_SERVERINFO,
+                               strlen(SUNSHINE_SERVERINFO), fields, 17,
+                               nullptr),
+             GS_INVALID);
+}
+
+static void test_applist() {
+    PAPP_LIST list = nullptr;
+    CHECK_EQ(xml_applist((char *)SUNSHINE_APPLIST, strlen(SUNSHINE_APPLIST),
+                         &list),
+             GS_OK);
+    // Apps are prepended while parsing
+    CHECK(list != nullptr && list->next != nullptr &&
+          list->next->next == nullptr);
+    if (list != nullptr && list->next != nullptr) {
+        CHECK(std::string(list->name) == "Steam Big Picture");
+        CHECK_EQ(list->id, 1093255277);
+        CHECK(std::string(list->next->name) == "Desktop");
+        CHECK_EQ(list->next->id, 881448767);
+    }
+    while (list != nullptr) {
+        PAPP_LIST next = list->next;
+        free(list->name);
+        free(list);
+        list = next;
+    }
+}
+
+static void bench() {
+    const int iterations = 20000;
+    const size_t len = strlen(SUNSHINE_SERVERINFO);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        ServerInfoResult result;
+        search_serverinfo(SUNSHINE_SERVERINFO, result);
+    }
+    std::chrono::duration<double, std::micro> single =
+        std::chrono::steady_clock::now() - start;
+
+    // What client.c did before, one parse per field plus the mode list
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        ServerInfoResult result;
+        for (int f = 0; f < SERVERINFO_FIELD_COUNT; f++) {
+            xml_search((char *)SUNSHINE_SERVERINFO, len,
+                       (char *)SERVERINFO_NODES[f], &result.values[f]);
+        }
+        xml_modelist((char *)SUNSHINE_SERVERINFO, len, &result.modes);
+    }
+    std::chrono::duration<double, std::micro> repeated =
+        std::chrono::steady_clock::now() - start;
+
+    printf("single pass: %.2f us per serverinfo\n",
+           single.count() / iterations);
+    printf("per field:   %.2f us per serverinfo\n",
+           repeated.count() / iterations);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        bench();
+        return 0;
+    }
+
+    RUN_TEST(test_sunshine_serverinfo);
+    RUN_TEST(test_gfe_serverinfo);
+    RUN_TEST(test_unauthorized_leaves_results_untouched);
+    RUN_TEST(test_malformed_is_invalid);
+    RUN_TEST(test_too_many_fields);
+    RUN_TEST(test_applist);
+    return TEST_RESULT();
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Times the CPU YUV conversion paths on the stream sizes the 3DS uses. Off ARM
+// both calls take the scalar path; build for an ARMv6 target with
+// __ARM_FEATURE_SIMD32 to see what the kernel gains.
+
+#include "video/n3ds/Yuv420ToRgb565.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+typedef void (*ConvertFn)(const uint8_t *const *, const int *, int, int,
+                          uint16_t *, int);
+
+static double time_ms(ConvertFn convert, const uint8_t *const *planes,
+                      const int *strides, int width, int height,
+                      uint16_t *dest, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        convert(planes, strides, width, height, dest, 1024);
+    }
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    const int sizes[][2] = {{400, 240}, {800, 240}, {800, 480}};
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (const auto &size : sizes) {
+        int width = size[0];
+        int height = size[1];
+        std::vector<uint8_t> y(width * height), u(width * height / 4),
+            v(width * height / 4);
+        for (std::vector<uint8_t> *plane : {&y, &u, &v}) {
+            for (uint8_t &value : *plane) {
+                value = (uint8_t)byte(rng);
+            }
+        }
+        const uint8_t *planes[3] = {y.data(), u.data(), v.data()};
+        const int strides[3] = {width, width / 2, width / 2};
+        std::vector<uint16_t> dest(1024 * 512);
+
+        printf("%dx%d: kernel %.3f ms, reference %.3f ms per frame\n", width,
+               height,
+               time_ms(yuv420_to_rgb565, planes, strides, width, height,
+                       dest.data(), iterations),
+               time_ms(yuv420_to_rgb565_reference, planes, strides, width,
+                       height, dest.data(), iterations));
+    }
+    return 0;
+}
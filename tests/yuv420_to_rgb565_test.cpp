@@ -0,0 +1,161 @@
+/*
+ * This file is part of Moonlight Embedded.
+ *
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test_common.hpp"
+#include "video/n3ds/Yuv420ToRgb565.hpp"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#define DEST_STRIDE 1024
+
+struct YuvImage {
+    int width, height;
+    int strides[3];
+    std::vector<uint8_t> planes[3];
+
+    YuvImage(int width_in, int height_in, int padding)
+        : width(width_in), height(height_in) {
+        int chroma_width = (width + 1) / 2;
+        int chroma_height = (height + 1) / 2;
+        strides[0] = width + padding;
+        strides[1] = strides[2] = chroma_width + padding;
+        planes[0].resize(strides[0] * height);
+        planes[1].resize(strides[1] * chroma_height);
+        planes[2].resize(strides[2] * chroma_height);
+    }
+
+    const uint8_t *const *data() {
+        ptrs[0] = planes[0].data();
+        ptrs[1] = planes[1].data();
+        ptrs[2] = planes[2].data();
+        return ptrs;
+    }
+
+    const uint8_t *ptrs[3];
+};
+
+// Converts with both paths, dest_offset shifts the output by whole pixels to
+// exercise the unaligned store path. Returns the number of differing pixels.
+static int compare_paths(YuvImage &image, int dest_offset) {
+    std::vector<uint16_t> simd(DEST_STRIDE * (image.height + 1) + 8, 0xDEAD);
+    std::vector<uint16_t> scalar(simd.size(), 0xDEAD);
+
+    yuv420_to_rgb565(image.data(), image.strides, image.width, image.height,
+                     simd.data() + dest_offset, DEST_STRIDE);
+    yuv420_to_rgb565_reference(image.data(), image.strides, image.width,
+                               image.height, scalar.data() + dest_offset,
+                               DEST_STRIDE);
+
+    int mismatches = 0;
+    for (size_t i = 0; i < simd.size(); i++) {
+        if (simd[i] != scalar[i]) {
+            if (mismatches == 0) {
+                fprintf(stderr, "  %dx%d+%d: first mismatch at %zu: %04x %04x\n",
+                        image.width, image.height, dest_offset, i, simd[i],
+                        scalar[i]);
+            }
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static void fill_random(YuvImage &image, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (std::vector<uint8_t> &plane : image.planes) {
+        for (uint8_t &value : plane) {
+            value = (uint8_t)byte(rng);
+        }
+    }
+}
+
+static void test_random_planes_match() {
+    std::mt19937 rng(1234);
+    const int sizes[][2] = {{400, 240}, {800, 480}, {8, 8},   {4, 2},
+                            {1, 1},     {3, 5},     {7, 3},   {13, 9},
+                            {401, 241}, {854, 480}, {1024, 2}};
+    for (const auto &size : sizes) {
+        for (int padding : {0, 32}) {
+            YuvImage image(size[0], size[1], padding);
+            fill_random(image, rng);
+            CHECK_EQ(compare_paths(image, 0), 0);
+            CHECK_EQ(compare_paths(image, 1), 0);
+        }
+    }
+}
+
+// Every (Y, U, V) combination at the range limits, where clamping kicks in
+static void test_edge_values_match() {
+    const uint8_t values[] = {0, 1, 15, 16, 17, 127, 128, 129, 235, 240, 254,
+                              255};
+    const int count = sizeof(values) / sizeof(values[0]);
+
+    YuvImage image(count * 2 * count, 2 * count, 0);
+    for (int yi = 0; yi < count; yi++) {
+        for (int ui = 0; ui < count; ui++) {
+            for (int vi = 0; vi < count; vi++) {
+                int cx = ui * count + vi;
+                int cy = yi;
+                image.planes[1][cy * image.strides[1] + cx] = values[ui];
+                image.planes[2][cy * image.strides[2] + cx] = values[vi];
+                for (int i = 0; i < 4; i++) {
+                    int x = cx * 2 + (i & 1);
+                    int y = cy * 2 + (i >> 1);
+                    image.planes[0][y * image.strides[0] + x] = values[yi];
+                }
+            }
+        }
+    }
+    CHECK_EQ(compare_paths(image, 0), 0);
+    CHECK_EQ(compare_paths(image, 3), 0);
+}
+
+static void test_known_colours() {
+    YuvImage image(4, 2, 0);
+    // Black, white, then limited range red
+    const uint8_t y[] = {16, 16, 235, 235};
+    memcpy(image.planes[0].data(), y, 4);
+    memcpy(image.planes[0].data() + 4, y, 4);
+    image.planes[1] = {128, 128};
+    image.planes[2] = {128, 128};
+
+    std::vector<uint16_t> dest(DEST_STRIDE * 2);
+    yuv420_to_rgb565(image.data(), image.strides, 4, 2, dest.data(),
+                     DEST_STRIDE);
+    CHECK_EQ(dest[0], 0x0000);
+    CHECK_EQ(dest[3], 0xFFFF);
+    CHECK_EQ(dest[DEST_STRIDE + 1], 0x0000);
+
+    // BT.709 red is Y=63, U=102, V=240
+    image.planes[0].assign(8, 63);
+    image.planes[1] = {102, 102};
+    image.planes[2] = {240, 240};
+    yuv420_to_rgb565(image.data(), image.strides, 4, 2, dest.data(),
+                     DEST_STRIDE);
+    CHECK(dest[0] >> 11 >= 30);
+    CHECK(((dest[0] >> 5) & 0x3F) <= 1);
+    CHECK((dest[0] & 0x1F) <= 1);
+}
+
+int main() {
+    RUN_TEST(test_random_planes_match);
+    RUN_TEST(test_edge_values_match);
+    RUN_TEST(test_known_colours);
+    return TEST_RESULT();
+}